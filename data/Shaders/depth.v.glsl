@@ -0,0 +1,12 @@
+#version 330 core
+
+layout (location = 0) in vec3 vPos;
+
+invariant gl_Position;
+
+uniform mat4 MVP;
+
+void main()
+{
+    gl_Position = MVP * vec4(vPos, 1.0);
+}
\ No newline at end of file
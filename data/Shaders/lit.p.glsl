@@ -4,6 +4,9 @@ precision mediump float;
 in vec3 pNormal;
 in vec4 pColor;
 in vec2 pTexCoord;
+#ifdef TEXTURE_ARRAY
+flat in float pLayer;
+#endif
 
 out vec4 FragColor;
 
@@ -11,12 +14,24 @@ uniform vec3 SunDirection;
 uniform vec3 SunColor;
 uniform float SunIntensity;
 
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray Texture;
+#else
 uniform sampler2D Texture;
+#endif
 uniform vec2 Tiling;
 
 void main()
 {
+#ifdef TEXTURE_ARRAY
+    vec4 albedo = texture(Texture, vec3(pTexCoord * Tiling, pLayer)) * pColor;
+#else
     vec4 albedo = texture(Texture, pTexCoord * Tiling) * pColor;
+#endif
+#ifdef CUTOUT
+    if (albedo.a < 0.5)
+        discard;
+#endif
     vec3 radiosity = albedo.rgb * SunColor;
 
     vec3 ambient = radiosity * pow(SunIntensity * 0.1, 0.5);
@@ -25,9 +40,6 @@ void main()
     vec3 diffuse = radiosity * SunIntensity * illumination;
 
     vec3 color = ambient + diffuse;
-    
-    int cutout = int(albedo.a >= 0.5);
-    gl_FragDepth = (cutout * gl_FragCoord.z) + (1 - cutout);
 
-    FragColor = vec4(color, 1.0);
+    FragColor = vec4(color, albedo.a);
 };
\ No newline at end of file
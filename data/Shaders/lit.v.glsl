@@ -2,12 +2,22 @@
 
 layout (location = 0) in vec3 vPos;
 layout (location = 1) in vec3 vNor;
+#ifdef VERTEX_COLOR
 layout (location = 2) in vec4 vCol;
+#endif
 layout (location = 3) in vec2 vTex;
+#ifdef TEXTURE_ARRAY
+layout (location = 4) in float vLayer;
+#endif
 
 out vec3 pNormal;
 out vec4 pColor;
 out vec2 pTexCoord;
+#ifdef TEXTURE_ARRAY
+flat out float pLayer;
+#endif
+
+invariant gl_Position;
 
 uniform mat4 Model;
 uniform mat4 MVP;
@@ -16,6 +26,13 @@ void main()
 {
     gl_Position = MVP * vec4(vPos, 1.0);
     pNormal = mat3(Model) * vNor;
+#ifdef VERTEX_COLOR
     pColor = vCol;
+#else
+    pColor = vec4(1.0);
+#endif
     pTexCoord = vTex;
+#ifdef TEXTURE_ARRAY
+    pLayer = vLayer;
+#endif
 }
\ No newline at end of file
@@ -19,10 +19,9 @@ bool Application::Initialize(sf::RenderWindow& window)
     float height = (float)size.y;
     float aspect = width / height;
 
-    Graphics::SetViewport(0, 0, width, height);
+    viewport = glm::ivec4(0, 0, size.x, size.y);
     scene.camera.projection = glm::perspective(70.0f, aspect, 0.1f, 1000.0f);
 
-    window.setVerticalSyncEnabled(true);
     //window.setMouseCursorGrabbed(true);
     //window.setMouseCursorVisible(false);
     //window.setKeyRepeatEnabled(false);
@@ -41,21 +40,27 @@ bool Application::Initialize(sf::RenderWindow& window)
     Graphics::SetBlendFunc(BlendFunc::INTERPOLATE);
 
     // Init variables
-    scene.sun.direction = glm::normalize(glm::vec3(1, 3, -10));
+    DirectionalLight sun;
+    sun.direction = glm::normalize(glm::vec3(1, 3, -10));
 
-    scene.sun.color = glm::vec3(0.95f, 0.95f, 1.0f); // Day
-    scene.sun.intensisty = 1.15f;
-    //scene.sun.color = glm::vec3(0.15f, 0.25f, 0.4f); // Night
-    //scene.sun.intensisty = 0.2f;
+    sun.color = glm::vec3(0.95f, 0.95f, 1.0f); // Day
+    sun.intensisty = 1.15f;
+    //sun.color = glm::vec3(0.15f, 0.25f, 0.4f); // Night
+    //sun.intensisty = 0.2f;
+    scene.Spawn(sun);
 
-    scene.camera.position = glm::vec3(0.0f, 0.0f, 1.7f);
-    scene.camera.rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+    camera.position = glm::vec3(0.0f, 0.0f, 1.7f);
+    camera.rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+    prevCamera = camera;
 
     mousePos = (sf::Vector2f)sf::Mouse::getPosition();
 
     // Load shaders
-    blitShader = Graphics::CreateShader(Utility::LoadTextFile("data/Shaders/blit.v.glsl").c_str(), Utility::LoadTextFile("data/Shaders/blit.p.glsl").c_str(), nullptr);
-    litShader = Graphics::CreateShader(Utility::LoadTextFile("data/Shaders/lit.v.glsl").c_str(), Utility::LoadTextFile("data/Shaders/lit.p.glsl").c_str(), nullptr);
+    blitShader = Engine::Shaders().Load("data/Shaders/blit.v.glsl", "data/Shaders/blit.p.glsl");
+    depthShader = Engine::Shaders().Load("data/Shaders/depth.v.glsl", "data/Shaders/depth.p.glsl");
+
+    // Sponza's colonnades overdraw heavily, so pay for the extra depth pass to shade each pixel once
+    scene.depthShader = depthShader;
 
     // Load screen model
     //screen = Utility::LoadModel("data/Shaders/screen.obj");
@@ -63,28 +68,113 @@ bool Application::Initialize(sf::RenderWindow& window)
     //screen.material.attributeFormat.emplace_back("vPos", 2);
 
     // Load scene
-    std::vector<Model> sponza = Utility::LoadScene("data/Sponza", "sponza.obj");
-    for (size_t i = 0; i < sponza.size(); ++i)
+    assets.resize(2);
+    assets[0].directory = "data/Sponza";
+    assets[0].filename = "sponza.obj";
+    assets[0].packTextures = true;
+    assets[0].bakeStatic = true;
+    assets[0].rotation.x = 90.0f;
+    assets[0].scale = glm::vec3(0.1f);
+
+    assets[1].directory = "data/Statue";
+    assets[1].filename = "statue.obj";
+    assets[1].rotation.z = 90.0f;
+    assets[1].scale = glm::vec3(0.02f);
+
+    for (size_t i = 0; i < assets.size(); ++i)
     {
-        sponza[i].transform.rotation.x = 90.0f;
-        sponza[i].transform.scale = glm::vec3(0.1f);
+        std::vector<std::string> dependencies;
+        if (!LoadAsset(assets[i], assets[i].models, dependencies))
+            return false;
 
-        sponza[i].material.shader = litShader;
+        WatchAsset(i, dependencies);
+        SpawnAsset(i);
     }
 
-    std::vector<Model> statue = Utility::LoadScene("data/Statue", "statue.obj");
-    for (size_t i = 0; i < statue.size(); ++i)
+    return true;
+}
+
+bool Application::LoadAsset(const Asset& asset, std::vector<Model>& models, std::vector<std::string>& dependencies) const
+{
+    Transform transform;
+    transform.rotation = asset.rotation;
+    transform.scale = asset.scale;
+
+    if (!Utility::LoadScene(asset.directory, asset.filename, models, asset.packTextures, &dependencies, asset.bakeStatic ? &transform : nullptr))
+        return false;
+
+    for (size_t i = 0; i < models.size(); ++i)
+        models[i].material.shader = GetLitShader(models[i].material);
+    return true;
+}
+
+void Application::WatchAsset(size_t index, const std::vector<std::string>& dependencies)
+{
+    Asset& asset = assets[index];
+    for (size_t i = 0; i < asset.watches.size(); ++i)
+        Engine::Files().Unwatch(asset.watches[i]);
+    asset.watches.clear();
+
+    // Importing creates GL resources, so it happens on the GL thread and Update swaps the result in
+    for (size_t i = 0; i < dependencies.size(); ++i)
     {
-        statue[i].transform.rotation.z = 90.0f;
-        statue[i].transform.scale = glm::vec3(0.02f);
+        asset.watches.push_back(Engine::Files().Watch(dependencies[i], [this, index]()
+        {
+            Engine::Defer([this, index]()
+            {
+                // A broken file leaves the previous models and watches in place until it is saved again
+                AssetReload reload;
+                reload.index = index;
+                if (!LoadAsset(assets[index], reload.models, reload.dependencies))
+                {
+                    std::cerr << "Keeping the previous " << assets[index].filename << std::endl;
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(reloadMutex);
+                reloads.push_back(std::move(reload));
+            });
+        }));
+    }
+}
 
-        statue[i].material.shader = litShader;
+void Application::SpawnAsset(size_t index)
+{
+    // Only the reloaded asset is respawned, entities of the others keep their ids
+    Asset& asset = assets[index];
+    if (asset.root != 0)
+        scene.Destroy(asset.root);
+
+    // The asset's orientation lives on a root node, its models never move so the whole subtree is baked once.
+    // Baked assets already carry it in their vertices
+    Transform transform;
+    if (!asset.bakeStatic)
+    {
+        transform.rotation = asset.rotation;
+        transform.scale = asset.scale;
     }
+    asset.root = scene.Spawn(transform);
+    for (size_t i = 0; i < asset.models.size(); ++i)
+        scene.Spawn(asset.models[i], asset.root);
+    scene.SetStatic(asset.root, true);
+}
 
-    scene.models.insert(scene.models.end(), sponza.begin(), sponza.end());
-    scene.models.insert(scene.models.end(), statue.begin(), statue.end());
+Shader Application::GetLitShader(const Material& material) const
+{
+    // Only cutout materials pay for discard, everything else keeps early depth testing
+    std::vector<std::string> defines;
+    if (material.albedoArray)
+        defines.emplace_back("TEXTURE_ARRAY");
+    if (material.alphaMode == AlphaMode::CUTOUT)
+        defines.emplace_back("CUTOUT");
+    const std::vector<AttributeFormat>& attributeFormat = Graphics::GetLayout(material.layout);
+    for (size_t i = 0; i < attributeFormat.size(); ++i)
+    {
+        if (attributeFormat[i].attribute == "vCol")
+            defines.emplace_back("VERTEX_COLOR");
+    }
 
-    return true;
+    return Engine::Shaders().Load("data/Shaders/lit.v.glsl", "data/Shaders/lit.p.glsl", defines);
 }
 
 void Application::Input(const sf::Event& e)
@@ -95,14 +185,34 @@ void Application::Input(const sf::Event& e)
         float height = (float)e.size.height;
         float aspect = width / height;
 
-        Graphics::SetViewport(0, 0, width, height);
+        viewport = glm::ivec4(0, 0, e.size.width, e.size.height);
         scene.camera.projection = glm::perspective(70.0f, aspect, 0.1f, 1000.0f);
     }
 }
 
 void Application::Update(const sf::Time& deltaTime)
 {
+    std::vector<AssetReload> finished;
+    {
+        std::lock_guard<std::mutex> lock(reloadMutex);
+        finished.swap(reloads);
+    }
+
+    // Frames recorded before the swap may still draw the old models, deferring the release waits them out
+    for (size_t i = 0; i < finished.size(); ++i)
+    {
+        Asset& asset = assets[finished[i].index];
+        std::vector<Model> previous;
+        previous.swap(asset.models);
+        asset.models.swap(finished[i].models);
+        WatchAsset(finished[i].index, finished[i].dependencies);
+        SpawnAsset(finished[i].index);
+
+        Engine::Defer([previous]() { Utility::ReleaseModels(previous); });
+    }
+
     float dt = deltaTime.asSeconds();
+    prevCamera = camera;
 
     sf::Vector2f mouseTarget = (sf::Vector2f)sf::Mouse::getPosition();
     sf::Vector2f mouseDelta = 0.5f * (mouseTarget - mousePos);
@@ -110,11 +220,11 @@ void Application::Update(const sf::Time& deltaTime)
 
     if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Right))
     {
-        scene.camera.rotation.z -= mouseDelta.x * lookSpeed * dt;
-        scene.camera.rotation.x -= mouseDelta.y * lookSpeed * dt;
+        camera.rotation.z -= mouseDelta.x * lookSpeed * dt;
+        camera.rotation.x -= mouseDelta.y * lookSpeed * dt;
 
         constexpr float xRange = glm::pi<float>() * 0.45f;
-        scene.camera.rotation.x = glm::clamp(scene.camera.rotation.x, -xRange, xRange);
+        camera.rotation.x = glm::clamp(camera.rotation.x, -xRange, xRange);
     }
 
     glm::vec3 move = glm::vec3(0, 0, 0);
@@ -136,15 +246,25 @@ void Application::Update(const sf::Time& deltaTime)
     if (glm::dot(move, move) > 1)
         move = glm::normalize(move);
 
-    scene.camera.position += glm::quat(scene.camera.rotation) * move * moveSpeed * dt;
+    camera.position += glm::quat(camera.rotation) * move * moveSpeed * dt;
 
     //std::cout << "CamPos: " << glm::to_string(camPos) << std::endl;
     //std::cout << "CamRot: " << glm::to_string(camRot) << std::endl;
 }
 
-void Application::Render()
+void Application::Interpolate(float alpha)
 {
-    scene.Render();
+    scene.camera.position = glm::mix(prevCamera.position, camera.position, alpha);
+    scene.camera.rotation = glm::mix(prevCamera.rotation, camera.rotation, alpha);
+}
+
+void Application::Render(RenderPacket& packet)
+{
+    packet.viewport = viewport;
+    scene.UpdateTransforms();
+    scene.SelectLods(viewport);
+    scene.UpdateOcclusion(viewport);
+    scene.Build(packet);
 
     // Render to screen quad
     //Graphics::BindBuffer(screen.mesh.vBuffer, false);
@@ -160,6 +280,20 @@ void Application::Render()
 
 void Application::Clean()
 {
-    Graphics::DeleteShader(blitShader);
-    Graphics::DeleteShader(litShader);
+    for (size_t i = 0; i < assets.size(); ++i)
+    {
+        Utility::ReleaseModels(assets[i].models);
+        assets[i].models.clear();
+    }
+
+    // Imports that finished after the last update never made it into an asset
+    std::lock_guard<std::mutex> lock(reloadMutex);
+    for (size_t i = 0; i < reloads.size(); ++i)
+        Utility::ReleaseModels(reloads[i].models);
+    reloads.clear();
+
+    Utility::ReleaseTextures();
+    scene.Clear();
+
+    // Shaders belong to Engine::Shaders(), which releases them after this
 }
\ No newline at end of file
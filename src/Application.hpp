@@ -2,24 +2,68 @@
 
 #include <Framework/Framework.hpp>
 
+#include <mutex>
+#include <string>
+#include <vector>
+
 class Application : public IApplication
 {
 public:
 	virtual bool Initialize(sf::RenderWindow& window);
 	virtual void Input(const sf::Event& e);
 	virtual void Update(const sf::Time& deltaTime);
-	virtual void Render();
+	virtual void Interpolate(float alpha);
+	virtual void Render(RenderPacket& packet);
 	virtual void Clean();
 
 private:
+	// Imported file and the transform of the node its models hang under
+	struct Asset
+	{
+		std::string directory;
+		std::string filename;
+		bool packTextures = false;
+		// Static assets are imported with their transform applied and share buffers
+		bool bakeStatic = false;
+		glm::vec3 rotation = glm::vec3(0);
+		glm::vec3 scale = glm::vec3(1);
+
+		std::vector<Model> models;
+		Entity root = 0;
+		std::vector<unsigned int> watches;
+	};
+
+	struct AssetReload
+	{
+		size_t index;
+		std::vector<Model> models;
+		std::vector<std::string> dependencies;
+	};
+
+	Shader GetLitShader(const Material& material) const;
+	bool LoadAsset(const Asset& asset, std::vector<Model>& models, std::vector<std::string>& dependencies) const;
+	void WatchAsset(size_t index, const std::vector<std::string>& dependencies);
+	void SpawnAsset(size_t index);
+
+	std::vector<Asset> assets;
+
+	// Imported again on the GL thread after a file changed, waiting for Update to swap them in
+	std::mutex reloadMutex;
+	std::vector<AssetReload> reloads;
+
 	sf::Vector2f mousePos;
+	glm::ivec4 viewport;
 
 	float moveSpeed = 25.0f;
 	float lookSpeed = 0.5f;
 
 	Shader blitShader;
-	Shader litShader;
+	Shader depthShader;
 	
+	// Simulated camera states, the scene camera is interpolated between them
+	Camera camera;
+	Camera prevCamera;
+
 	Model screen;
 	Scene scene;
 };
\ No newline at end of file
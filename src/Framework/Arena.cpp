@@ -0,0 +1,72 @@
+#include "Arena.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#define ASSERT(expr) assert(expr)
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize)
+{}
+
+Arena::~Arena()
+{
+    for (size_t i = 0; i < blocks.size(); ++i)
+        std::free(blocks[i].pData);
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+    ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    if (!blocks.empty())
+    {
+        Block& block = blocks.back();
+        size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= block.size)
+        {
+            block.used = offset + size;
+            return block.pData + offset;
+        }
+    }
+
+    // Oversized requests get a block of their own rather than wasting the rest of a regular one
+    Block block;
+    block.size = size + alignment > blockSize ? size + alignment : blockSize;
+    block.pData = static_cast<unsigned char*>(std::malloc(block.size));
+    if (block.pData == nullptr)
+        throw std::bad_alloc();
+
+    size_t offset = (alignment - (uintptr_t)block.pData % alignment) % alignment;
+    block.used = offset + size;
+    blocks.push_back(block);
+    allocatedBytes += block.size;
+    return block.pData + offset;
+}
+
+Arena::Marker Arena::GetMarker() const
+{
+    Marker marker;
+    if (!blocks.empty())
+    {
+        marker.block = blocks.size() - 1;
+        marker.offset = blocks.back().used;
+    }
+    return marker;
+}
+
+void Arena::Rewind(const Marker& marker)
+{
+    if (blocks.empty())
+        return;
+
+    while (blocks.size() > marker.block + 1)
+    {
+        allocatedBytes -= blocks.back().size;
+        std::free(blocks.back().pData);
+        blocks.pop_back();
+    }
+    blocks.back().used = marker.offset;
+}
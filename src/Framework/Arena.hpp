@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for temporaries that die together, memory is only given back on Rewind or destruction
+class Arena
+{
+public:
+	struct Marker
+	{
+		size_t block = 0;
+		size_t offset = 0;
+	};
+
+	explicit Arena(size_t blockSize = 1 << 20);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment);
+
+	// Frees everything allocated since the marker was taken
+	Marker GetMarker() const;
+	void Rewind(const Marker& marker);
+
+	size_t GetAllocatedBytes() const { return allocatedBytes; }
+
+private:
+	struct Block
+	{
+		unsigned char* pData;
+		size_t size;
+		size_t used;
+	};
+
+	size_t blockSize;
+	size_t allocatedBytes = 0;
+	std::vector<Block> blocks;
+};
+
+// Lets standard containers draw from an arena, deallocation is a no-op so reserve up front
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(Arena& arena) : pArena(&arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : pArena(other.pArena) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(pArena->Allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+
+	Arena* pArena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.pArena == b.pArena; }
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.pArena != b.pArena; }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
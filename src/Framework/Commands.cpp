@@ -0,0 +1,133 @@
+#include "Commands.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#define ASSERT(expr) assert(expr)
+
+uint64_t CommandList::MakeKey(RenderPass pass, Shader shader, Texture texture, float depth)
+{
+    uint32_t depthBits;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    // Blending needs back to front order, so depth dominates over state there
+    uint64_t passBits = (uint64_t)pass << 62;
+    if (pass == RenderPass::BLEND)
+        return passBits | ((uint64_t)~depthBits << 16) | (shader & 0xFFFF);
+
+    // State changes dominate, depth only orders draws that share shader and texture front to back
+    return passBits | ((uint64_t)(shader & 0x3FFF) << 48) | ((uint64_t)(texture & 0xFFFF) << 32) | depthBits;
+}
+
+RenderPass CommandList::GetPass(uint64_t key)
+{
+    return (RenderPass)(key >> 62);
+}
+
+void CommandList::Clear()
+{
+    commands.clear();
+    constants.clear();
+    packets.clear();
+    rangeOffsets.clear();
+    rangeCounts.clear();
+}
+
+void CommandList::Begin(uint64_t key)
+{
+    CommandPacket packet;
+    packet.key = key;
+    packet.first = (unsigned int)commands.size();
+    packet.count = 0;
+    packets.push_back(packet);
+}
+
+void CommandList::BindMesh(Buffer vBuffer, Buffer iBuffer)
+{
+    Command command;
+    command.type = CommandType::BIND_MESH;
+    command.bindMesh.vBuffer = vBuffer;
+    command.bindMesh.iBuffer = iBuffer;
+    commands.push_back(command);
+}
+
+void CommandList::BindMaterial(Shader shader, Texture albedo, bool albedoArray, Layout layout)
+{
+    Command command;
+    command.type = CommandType::BIND_MATERIAL;
+    command.bindMaterial.shader = shader;
+    command.bindMaterial.albedo = albedo;
+    command.bindMaterial.albedoArray = albedoArray;
+    command.bindMaterial.layout = layout;
+    commands.push_back(command);
+}
+
+void CommandList::SetConstants(const glm::mat4& model, const glm::mat4& mvp)
+{
+    Command command;
+    command.type = CommandType::SET_CONSTANTS;
+    command.setConstants.index = (unsigned int)constants.size();
+    commands.push_back(command);
+
+    DrawConstants drawConstants;
+    drawConstants.model = model;
+    drawConstants.mvp = mvp;
+    constants.push_back(drawConstants);
+}
+
+void CommandList::Draw(Primitive primitive, bool indexed, unsigned int offset, unsigned int count)
+{
+    Command command;
+    command.type = CommandType::DRAW;
+    command.draw.primitive = primitive;
+    command.draw.indexed = indexed;
+    command.draw.offset = offset;
+    command.draw.count = count;
+    commands.push_back(command);
+}
+
+void CommandList::DrawRanges(Primitive primitive, const unsigned int* pOffsets, const int* pCounts, unsigned int count)
+{
+    Command command;
+    command.type = CommandType::DRAW_RANGES;
+    command.drawRanges.primitive = primitive;
+    command.drawRanges.first = (unsigned int)rangeOffsets.size();
+    command.drawRanges.count = count;
+    commands.push_back(command);
+
+    rangeOffsets.insert(rangeOffsets.end(), pOffsets, pOffsets + count);
+    rangeCounts.insert(rangeCounts.end(), pCounts, pCounts + count);
+}
+
+void CommandList::End()
+{
+    ASSERT(!packets.empty());
+    packets.back().count = (unsigned int)commands.size() - packets.back().first;
+}
+
+void CommandList::Sort(const std::vector<CommandList>& lists, std::vector<CommandRef>& order)
+{
+    order.clear();
+    for (size_t i = 0; i < lists.size(); ++i)
+    {
+        for (size_t j = 0; j < lists[i].packets.size(); ++j)
+        {
+            CommandRef ref;
+            ref.key = lists[i].packets[j].key;
+            ref.list = (unsigned int)i;
+            ref.packet = (unsigned int)j;
+            order.push_back(ref);
+        }
+    }
+
+    // Ties keep recording order so the result does not depend on how work was split
+    std::sort(order.begin(), order.end(), [](const CommandRef& a, const CommandRef& b)
+    {
+        if (a.key != b.key)
+            return a.key < b.key;
+        if (a.list != b.list)
+            return a.list < b.list;
+        return a.packet < b.packet;
+    });
+}
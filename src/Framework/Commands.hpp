@@ -0,0 +1,117 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <Framework/Graphics.hpp>
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+enum struct CommandType { BIND_MESH, BIND_MATERIAL, SET_CONSTANTS, DRAW, DRAW_RANGES };
+
+enum struct AlphaMode { SOLID, CUTOUT, BLEND };
+
+// In submission order, solid geometry comes before the rest so it fills depth first
+enum struct RenderPass { DEPTH, SOLID, CUTOUT, BLEND };
+
+struct BindMeshCommand
+{
+	Buffer vBuffer;
+	Buffer iBuffer;
+};
+
+struct BindMaterialCommand
+{
+	Shader shader;
+	Texture albedo;
+	bool albedoArray;
+	Layout layout;
+};
+
+struct SetConstantsCommand
+{
+	unsigned int index;
+};
+
+struct DrawCommand
+{
+	Primitive primitive;
+	bool indexed;
+	unsigned int offset;
+	unsigned int count;
+};
+
+// Indexed ranges of one mesh drawn in a single call, first indexes the list's range arrays
+struct DrawRangesCommand
+{
+	Primitive primitive;
+	unsigned int first;
+	unsigned int count;
+};
+
+struct Command
+{
+	CommandType type;
+	union
+	{
+		BindMeshCommand bindMesh;
+		BindMaterialCommand bindMaterial;
+		SetConstantsCommand setConstants;
+		DrawCommand draw;
+		DrawRangesCommand drawRanges;
+	};
+};
+
+struct DrawConstants
+{
+	glm::mat4 model;
+	glm::mat4 mvp;
+};
+
+// A recorded packet is still submitted after the main thread rebuilt or reloaded the scene, so commands
+// carry handles and values only and never point into models
+static_assert(std::is_trivially_copyable<Command>::value, "Commands must not own or reference model data");
+
+// A contiguous run of commands that is sorted as one unit
+struct CommandPacket
+{
+	uint64_t key;
+	unsigned int first;
+	unsigned int count;
+};
+
+// Position of a packet across a set of lists, used to replay several lists in key order
+struct CommandRef
+{
+	uint64_t key;
+	unsigned int list;
+	unsigned int packet;
+};
+
+// Records draws without touching the graphics API, one list per thread
+class CommandList
+{
+public:
+	static uint64_t MakeKey(RenderPass pass, Shader shader, Texture texture, float depth);
+	static RenderPass GetPass(uint64_t key);
+
+	void Clear();
+
+	void Begin(uint64_t key);
+	void BindMesh(Buffer vBuffer, Buffer iBuffer);
+	void BindMaterial(Shader shader, Texture albedo, bool albedoArray, Layout layout);
+	void SetConstants(const glm::mat4& model, const glm::mat4& mvp);
+	void Draw(Primitive primitive, bool indexed, unsigned int offset, unsigned int count);
+	void DrawRanges(Primitive primitive, const unsigned int* pOffsets, const int* pCounts, unsigned int count);
+	void End();
+
+	// Merges the packets of every list into a single key ordered sequence
+	static void Sort(const std::vector<CommandList>& lists, std::vector<CommandRef>& order);
+
+	std::vector<Command> commands;
+	std::vector<DrawConstants> constants;
+	std::vector<CommandPacket> packets;
+	std::vector<unsigned int> rangeOffsets;
+	std::vector<int> rangeCounts;
+};
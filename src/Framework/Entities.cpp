@@ -0,0 +1,41 @@
+#include "Entities.hpp"
+
+#define ASSERT(expr) assert(expr)
+
+static const unsigned int generationMask = (1u << (32 - EntityPool::indexBits)) - 1;
+
+Entity EntityPool::Create()
+{
+    unsigned int index;
+    if (!freeIndices.empty())
+    {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    }
+    else
+    {
+        index = (unsigned int)generations.size();
+        ASSERT(index < indexMask);
+        generations.push_back(0);
+    }
+
+    ++count;
+    return (generations[index] << indexBits) | (index + 1);
+}
+
+void EntityPool::Destroy(Entity entity)
+{
+    ASSERT(IsAlive(entity));
+
+    // The bumped generation is what turns every copy of the id stale
+    unsigned int index = GetIndex(entity);
+    generations[index] = (generations[index] + 1) & generationMask;
+    freeIndices.push_back(index);
+    --count;
+}
+
+bool EntityPool::IsAlive(Entity entity) const
+{
+    unsigned int index = GetIndex(entity);
+    return entity != 0 && index < generations.size() && generations[index] == entity >> indexBits;
+}
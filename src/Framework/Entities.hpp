@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Index + 1 in the low bits and a generation in the high bits, 0 is never a live entity
+using Entity = unsigned int;
+
+// Hands out entity ids, an id stays valid until it is destroyed and a destroyed one never comes back to life
+class EntityPool
+{
+public:
+	static const unsigned int indexBits = 20;
+	static const unsigned int indexMask = (1u << indexBits) - 1;
+
+	Entity Create();
+	void Destroy(Entity entity);
+	bool IsAlive(Entity entity) const;
+	size_t GetCount() const { return count; }
+
+	static unsigned int GetIndex(Entity entity) { return (entity & indexMask) - 1; }
+
+private:
+	std::vector<unsigned int> generations;
+	std::vector<unsigned int> freeIndices;
+	size_t count = 0;
+};
+
+// Sparse set, components are packed in a dense array so systems iterate them linearly. Removal moves
+// the last component into the gap, pools filled and emptied together therefore keep the same order
+template <typename T>
+class ComponentPool
+{
+public:
+	T& Add(Entity entity, const T& component)
+	{
+		unsigned int index = EntityPool::GetIndex(entity);
+		if (index >= sparse.size())
+			sparse.resize(index + 1, 0);
+
+		if (sparse[index] != 0 && entities[sparse[index] - 1] == entity)
+			return components[sparse[index] - 1] = component;
+
+		entities.push_back(entity);
+		components.push_back(component);
+		sparse[index] = (unsigned int)entities.size();
+		return components.back();
+	}
+
+	void Remove(Entity entity)
+	{
+		if (!Has(entity))
+			return;
+
+		unsigned int index = EntityPool::GetIndex(entity);
+		unsigned int dense = sparse[index] - 1;
+		entities[dense] = entities.back();
+		components[dense] = components.back();
+		sparse[EntityPool::GetIndex(entities[dense])] = dense + 1;
+		sparse[index] = 0;
+
+		entities.pop_back();
+		components.pop_back();
+	}
+
+	bool Has(Entity entity) const
+	{
+		unsigned int index = EntityPool::GetIndex(entity);
+		return index < sparse.size() && sparse[index] != 0 && entities[sparse[index] - 1] == entity;
+	}
+
+	T& Get(Entity entity)
+	{
+		assert(Has(entity));
+		return components[sparse[EntityPool::GetIndex(entity)] - 1];
+	}
+
+	const T& Get(Entity entity) const
+	{
+		assert(Has(entity));
+		return components[sparse[EntityPool::GetIndex(entity)] - 1];
+	}
+
+	void Clear()
+	{
+		sparse.clear();
+		entities.clear();
+		components.clear();
+	}
+
+	size_t Size() const { return entities.size(); }
+
+	// Dense order, entities[i] owns components[i]
+	const std::vector<Entity>& GetEntities() const { return entities; }
+	std::vector<T>& GetComponents() { return components; }
+	const std::vector<T>& GetComponents() const { return components; }
+
+private:
+	// Dense index + 1 per entity index, 0 when the entity has no component here
+	std::vector<unsigned int> sparse;
+	std::vector<Entity> entities;
+	std::vector<T> components;
+};
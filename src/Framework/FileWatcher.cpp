@@ -0,0 +1,151 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define ASSERT(expr) assert(expr)
+
+time_t GetModifiedTime(const std::string& filepath)
+{
+    struct stat info;
+    return stat(filepath.c_str(), &info) == 0 ? info.st_mtime : 0;
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (inotify >= 0)
+        close(inotify);
+#endif
+}
+
+unsigned int FileWatcher::Watch(const std::string& filepath, const std::function<void()>& callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::string directory;
+    std::string path = Normalize(filepath, directory);
+
+    File& file = files[path];
+    if (file.callbacks.empty())
+        file.modified = GetModifiedTime(path);
+
+#ifdef __linux__
+    if (inotify < 0)
+        inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    // Watch the directory rather than the file, editors often save by replacing it
+    bool watched = false;
+    for (auto it = directories.begin(); it != directories.end() && !watched; ++it)
+        watched = it->second == directory;
+
+    if (inotify >= 0 && !watched)
+    {
+        int wd = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd >= 0)
+            directories[wd] = directory;
+    }
+#endif
+
+    unsigned int id = nextId++;
+    file.callbacks[id] = callback;
+    watches[id] = path;
+    return id;
+}
+
+void FileWatcher::Unwatch(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto watch = watches.find(id);
+    if (watch == watches.end())
+        return;
+
+    auto file = files.find(watch->second);
+    file->second.callbacks.erase(id);
+    if (file->second.callbacks.empty())
+        files.erase(file);
+    watches.erase(watch);
+}
+
+void FileWatcher::Poll()
+{
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::vector<std::string> changed;
+        CollectChanges(changed);
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+        for (size_t i = 0; i < changed.size(); ++i)
+        {
+            auto file = files.find(changed[i]);
+            if (file == files.end())
+                continue;
+
+            for (auto it = file->second.callbacks.begin(); it != file->second.callbacks.end(); ++it)
+                callbacks.push_back(it->second);
+        }
+    }
+
+    // Outside the lock so callbacks can watch and unwatch
+    for (size_t i = 0; i < callbacks.size(); ++i)
+        callbacks[i]();
+}
+
+std::string FileWatcher::Normalize(const std::string& filepath, std::string& directory) const
+{
+    std::string path = filepath;
+    std::replace(path.begin(), path.end(), '\\', '/');
+
+    size_t slash = path.find_last_of('/');
+    directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    return slash == std::string::npos ? "./" + path : path;
+}
+
+void FileWatcher::CollectChanges(std::vector<std::string>& changed)
+{
+#ifdef __linux__
+    if (inotify >= 0)
+    {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+            {
+                const inotify_event* pEvent = (const inotify_event*)p;
+                auto directory = directories.find(pEvent->wd);
+                if (pEvent->len > 0 && directory != directories.end())
+                    changed.push_back(directory->second + "/" + pEvent->name);
+            }
+        }
+        return;
+    }
+#endif
+
+    // Without notifications every file is checked, but only a couple of times a second
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - lastScan < std::chrono::milliseconds(500))
+        return;
+    lastScan = now;
+
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        time_t modified = GetModifiedTime(it->first);
+        if (modified != it->second.modified)
+        {
+            it->second.modified = modified;
+            changed.push_back(it->first);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Calls back when watched files change on disk, through inotify on Linux and modification times elsewhere
+class FileWatcher
+{
+public:
+	~FileWatcher();
+
+	// Any thread, returns an id for Unwatch
+	unsigned int Watch(const std::string& filepath, const std::function<void()>& callback);
+	void Unwatch(unsigned int id);
+
+	// Main thread once per frame, callbacks run from here
+	void Poll();
+
+private:
+	struct File
+	{
+		time_t modified = 0;
+		std::map<unsigned int, std::function<void()>> callbacks;
+	};
+
+	std::string Normalize(const std::string& filepath, std::string& directory) const;
+	void CollectChanges(std::vector<std::string>& changed);
+
+	std::mutex mutex;
+	std::map<std::string, File> files;
+	std::map<unsigned int, std::string> watches;
+	unsigned int nextId = 1;
+
+	std::chrono::steady_clock::time_point lastScan;
+	int inotify = -1;
+	std::map<int, std::string> directories;
+};
@@ -4,56 +4,686 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include <cassert>
 #include <iostream>
 
-const std::vector<AttributeFormat> VertexPNCT::format({ { "vPos", 3 }, { "vNor", 3 }, { "vCol", 4 }, { "vTex", 2 } });
+#define ASSERT(expr) assert(expr)
 
-void Scene::Render()
+const Layout VertexPNCT::layout = Graphics::CreateLayout({ { "vPos", 3 }, { "vNor", 3 }, { "vCol", 4 }, { "vTex", 2 } });
+const Layout VertexP::layout = Graphics::CreateLayout({ { "vPos", 3 } });
+
+void ExtractFrustum(const glm::mat4& vp, glm::vec4 planes[6])
+{
+    glm::vec4 row0 = glm::vec4(vp[0][0], vp[1][0], vp[2][0], vp[3][0]);
+    glm::vec4 row1 = glm::vec4(vp[0][1], vp[1][1], vp[2][1], vp[3][1]);
+    glm::vec4 row2 = glm::vec4(vp[0][2], vp[1][2], vp[2][2], vp[3][2]);
+    glm::vec4 row3 = glm::vec4(vp[0][3], vp[1][3], vp[2][3], vp[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row3 + row2;
+    planes[5] = row3 - row2;
+}
+
+bool IsVisible(const glm::vec4 planes[6], const Bounds& bounds, const glm::mat4& m)
+{
+    // Transform the box into world space as center and extents
+    glm::vec3 center = glm::vec3(m * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    glm::vec3 extents = (bounds.max - bounds.min) * 0.5f;
+    glm::mat3 absM = glm::mat3(glm::abs(glm::vec3(m[0])), glm::abs(glm::vec3(m[1])), glm::abs(glm::vec3(m[2])));
+    extents = absM * extents;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        glm::vec3 n = glm::vec3(planes[i]);
+        if (glm::dot(n, center) + planes[i].w + glm::dot(glm::abs(n), extents) < 0)
+            return false;
+    }
+    return true;
+}
+
+// Meshlets that survive the cone, frustum and occlusion tests, neighbours in the index buffer merge into one range
+void CullMeshlets(const std::vector<Meshlet>& meshlets, unsigned int firstIndex, const glm::vec4 planes[6], const glm::mat4& m, const glm::mat4& mvp, const glm::vec3& camera, const OcclusionBuffer* pOcclusion, std::vector<unsigned int>& offsets, std::vector<int>& counts)
+{
+    offsets.clear();
+    counts.clear();
+
+    glm::vec3 scales = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+    float maxScale = glm::max(scales.x, glm::max(scales.y, scales.z));
+    float minScale = glm::min(scales.x, glm::min(scales.y, scales.z));
+
+    // Cones hold in model space as long as the matrix keeps angles and winding
+    bool cones = maxScale - minScale <= maxScale * 0.001f && glm::determinant(glm::mat3(m)) > 0.0f;
+    glm::vec3 localCamera = cones ? glm::vec3(glm::inverse(m) * glm::vec4(camera, 1.0f)) : glm::vec3(0);
+
+    for (size_t i = 0; i < meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        if (cones && Meshlets::IsBackFacing(meshlet, localCamera))
+            continue;
+
+        glm::vec3 center = glm::vec3(m * glm::vec4(meshlet.center, 1.0f));
+        float radius = meshlet.radius * maxScale;
+        bool inside = true;
+        for (int j = 0; j < 6 && inside; ++j)
+            inside = glm::dot(glm::vec3(planes[j]), center) + planes[j].w >= -radius * glm::length(glm::vec3(planes[j]));
+        if (!inside)
+            continue;
+
+        if (pOcclusion != nullptr && !pOcclusion->IsVisible(meshlet.center - glm::vec3(meshlet.radius), meshlet.center + glm::vec3(meshlet.radius), mvp))
+            continue;
+
+        unsigned int offset = firstIndex + meshlet.offset;
+        if (!offsets.empty() && offsets.back() + (unsigned int)counts.back() == offset)
+        {
+            counts.back() += (int)meshlet.count;
+            continue;
+        }
+        offsets.push_back(offset);
+        counts.push_back((int)meshlet.count);
+    }
+}
+
+glm::mat4 ViewMatrix(const Camera& camera)
+{
+    return glm::lookAt(camera.position, camera.position + glm::quat(camera.rotation) * glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
+}
+
+glm::mat4 LocalMatrix(const Transform& transform)
+{
+    return glm::translate(glm::mat4(1), transform.position) * glm::mat4(glm::quat(glm::radians(transform.rotation))) * glm::scale(glm::mat4(1), transform.scale);
+}
+
+Entity Scene::Spawn(const Model& model, Entity parent)
+{
+    Entity entity = Spawn(model.transform, parent);
+    meshes.Add(entity, model.mesh);
+    materials.Add(entity, model.material);
+    bounds.Add(entity, model.bounds);
+    if (model.mesh.lodCount > 0)
+        lodStates.Add(entity, LodState());
+    if (model.mesh.meshlets != 0)
+    {
+        Clusters meshClusters;
+        meshClusters.meshlets = Meshlets::Get(model.mesh.meshlets);
+        if (meshClusters.meshlets)
+            clusters.Add(entity, meshClusters);
+    }
+    return entity;
+}
+
+Entity Scene::Spawn(const Transform& transform, Entity parent)
+{
+    Entity entity = entities.Create();
+    transforms.Add(entity, transform);
+
+    // Appending keeps the parent ahead of the child
+    SceneNode node;
+    node.entity = entity;
+    if (parent != 0)
+    {
+        unsigned int parentIndex = nodeIndices.Get(parent);
+        ASSERT(nodes[parentIndex].entity == parent);
+        node.parent = parentIndex + 1;
+        node.isStatic = nodes[parentIndex].isStatic;
+    }
+
+    nodeIndices.Add(entity, (unsigned int)nodes.size());
+    nodes.push_back(node);
+    worlds.push_back(glm::mat4(1));
+    hierarchyChanged = true;
+    return entity;
+}
+
+Entity Scene::Spawn(const DirectionalLight& light)
+{
+    Entity entity = entities.Create();
+    lights.Add(entity, light);
+    return entity;
+}
+
+void Scene::Release(Entity entity)
+{
+    transforms.Remove(entity);
+    meshes.Remove(entity);
+    materials.Remove(entity);
+    bounds.Remove(entity);
+    lodStates.Remove(entity);
+    clusters.Remove(entity);
+    lights.Remove(entity);
+    nodeIndices.Remove(entity);
+    entities.Destroy(entity);
+}
+
+void Scene::Destroy(Entity entity)
+{
+    if (!nodeIndices.Has(entity))
+    {
+        Release(entity);
+        return;
+    }
+
+    // Descendants follow their ancestors, so one forward scan finds every node whose parent went
+    size_t index = nodeIndices.Get(entity);
+    Release(entity);
+    nodes[index].entity = 0;
+    for (size_t i = index + 1; i < nodes.size(); ++i)
+    {
+        if (nodes[i].entity != 0 && nodes[i].parent != 0 && nodes[nodes[i].parent - 1].entity == 0)
+        {
+            Release(nodes[i].entity);
+            nodes[i].entity = 0;
+        }
+    }
+    hierarchyChanged = true;
+}
+
+void Scene::Clear()
+{
+    // Destroyed one at a time so ids handed out earlier stay stale
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].entity != 0)
+            Release(nodes[i].entity);
+    }
+    while (lights.Size() > 0)
+        Release(lights.GetEntities().back());
+
+    nodes.clear();
+    worlds.clear();
+    dynamicNodes.clear();
+    hierarchyChanged = false;
+}
+
+void Scene::SetStatic(Entity entity, bool isStatic)
+{
+    size_t index = nodeIndices.Get(entity);
+
+    // A static node under a moving parent would keep a stale world matrix
+    ASSERT(!isStatic || nodes[index].parent == 0 || nodes[nodes[index].parent - 1].isStatic);
+
+    std::vector<bool> subtree(nodes.size() - index, false);
+    subtree[0] = true;
+    nodes[index].isStatic = isStatic;
+    for (size_t i = index + 1; i < nodes.size(); ++i)
+    {
+        size_t parent = nodes[i].parent;
+        if (nodes[i].entity != 0 && parent > index && subtree[parent - 1 - index])
+        {
+            subtree[i - index] = true;
+            nodes[i].isStatic = isStatic;
+        }
+    }
+
+    // Also rebakes, which is how a moved static subtree is picked up
+    hierarchyChanged = true;
+}
+
+void Scene::UpdateTransforms()
+{
+    if (hierarchyChanged)
+    {
+        // Removal keeps the order, so parents only ever move down to lower indices than their children
+        std::vector<unsigned int> remap(nodes.size(), 0);
+        size_t count = 0;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (nodes[i].entity == 0)
+                continue;
+
+            SceneNode node = nodes[i];
+            if (node.parent != 0)
+                node.parent = remap[node.parent - 1] + 1;
+            remap[i] = (unsigned int)count;
+            nodeIndices.Get(node.entity) = (unsigned int)count;
+            nodes[count++] = node;
+        }
+        nodes.resize(count);
+        worlds.resize(count);
+
+        // Static nodes are baked here once, every frame after only walks the dynamic ones
+        dynamicNodes.clear();
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (!nodes[i].isStatic)
+            {
+                dynamicNodes.push_back((unsigned int)i);
+                continue;
+            }
+
+            glm::mat4 local = LocalMatrix(transforms.Get(nodes[i].entity));
+            worlds[i] = nodes[i].parent != 0 ? worlds[nodes[i].parent - 1] * local : local;
+        }
+
+        hierarchyChanged = false;
+    }
+
+    for (size_t i = 0; i < dynamicNodes.size(); ++i)
+    {
+        const SceneNode& node = nodes[dynamicNodes[i]];
+        glm::mat4 local = LocalMatrix(transforms.Get(node.entity));
+        worlds[dynamicNodes[i]] = node.parent != 0 ? worlds[node.parent - 1] * local : local;
+    }
+}
+
+const glm::mat4& Scene::GetWorld(Entity entity) const
+{
+    return worlds[nodeIndices.Get(entity)];
+}
+
+void Scene::SelectLods(const glm::ivec4& viewport)
+{
+    // Model space error times this over the distance gives pixels
+    float pixelsPerUnit = camera.projection[1][1] * viewport.w * 0.5f;
+
+    const std::vector<Entity>& selected = lodStates.GetEntities();
+    Engine::Jobs().ParallelFor("Scene::SelectLods", selected.size(), 256, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            Entity entity = selected[i];
+            const Mesh& mesh = meshes.Get(entity);
+            const Bounds& box = bounds.Get(entity);
+            const glm::mat4& m = GetWorld(entity);
+
+            glm::vec3 center = glm::vec3(m * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+            float radius = glm::length(glm::vec3(m * glm::vec4(box.max - box.min, 0.0f))) * 0.5f;
+            float distance = glm::max(glm::length(center - camera.position) - radius, 0.1f);
+            float scale = glm::max(glm::length(glm::vec3(m[0])), glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+            float pixels = scale * pixelsPerUnit / distance;
+
+            // Refine as soon as the current level shows too much, coarsen only once the next level is well within the limit
+            int level = lodStates.GetComponents()[i].level;
+            level = glm::min(level, mesh.lodCount);
+            while (level > 0 && mesh.lods[level - 1].error * pixels > lodPixelError)
+                level--;
+            while (level < mesh.lodCount && mesh.lods[level].error * pixels <= lodPixelError * lodHysteresis)
+                level++;
+            lodStates.GetComponents()[i].level = level;
+        }
+    });
+}
+
+void Scene::UpdateOcclusion(const glm::ivec4& viewport)
+{
+    if (occlusionWidth <= 0 || viewport.z <= 0 || viewport.w <= 0)
+    {
+        occlusion = OcclusionBuffer();
+        return;
+    }
+
+    glm::mat4 vp = camera.projection * ViewMatrix(camera);
+    glm::vec4 planes[6];
+    ExtractFrustum(vp, planes);
+
+    // Occluders outside the frustum hide nothing that is drawn
+    occlusion.Begin(occlusionWidth, glm::max(occlusionWidth * viewport.w / viewport.z, 1));
+    const std::vector<Entity>& entities = meshes.GetEntities();
+    for (size_t i = 0; i < entities.size(); i++)
+    {
+        const Mesh& mesh = meshes.GetComponents()[i];
+        if (mesh.occluder == 0)
+            continue;
+
+        const glm::mat4& m = GetWorld(entities[i]);
+        if (IsVisible(planes, bounds.Get(entities[i]), m))
+            occlusion.Rasterize(mesh.occluder, vp * m);
+    }
+    occlusion.End();
+}
+
+void Scene::Build(RenderPacket& packet) const
+{
+    packet.sun = lights.Size() > 0 ? lights.GetComponents()[0] : DirectionalLight();
+
+    glm::mat4 v = ViewMatrix(camera);
+    glm::mat4 vp = camera.projection * v;
+
+    glm::vec4 planes[6];
+    ExtractFrustum(vp, planes);
+    bool occlusionCulling = occlusionWidth > 0 && occlusion.GetRasterizedCount() > 0;
+
+    // Each job records the visible entities of its range into its own list. Culling walks bounds and
+    // world matrices only, meshes and materials are read for what survives
+    const std::vector<Entity>& renderables = bounds.GetEntities();
+    const size_t grain = 64;
+    packet.commandLists.resize((renderables.size() + grain - 1) / grain);
+    Engine::Jobs().ParallelFor("Scene::Build", renderables.size(), grain, [&](size_t begin, size_t end)
+    {
+        CommandList& list = packet.commandLists[begin / grain];
+        list.Clear();
+        std::vector<unsigned int> rangeOffsets;
+        std::vector<int> rangeCounts;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            Entity entity = renderables[i];
+            const Bounds& box = bounds.GetComponents()[i];
+            const glm::mat4& m = GetWorld(entity);
+            if (!IsVisible(planes, box, m))
+                continue;
+            if (occlusionCulling && !occlusion.IsVisible(box.min, box.max, vp * m))
+                continue;
+
+            const Mesh& mesh = meshes.Get(entity);
+            const Material& material = materials.Get(entity);
+
+            unsigned int offset = mesh.offset;
+            unsigned int count = mesh.count;
+            if (mesh.lodCount > 0 && lodStates.Has(entity))
+            {
+                int level = lodStates.Get(entity).level;
+                if (level > 0)
+                {
+                    offset = mesh.lods[level - 1].offset;
+                    count = mesh.lods[level - 1].count;
+                }
+            }
+
+            // Meshlets only cover the full level, a coarser one is drawn whole
+            rangeOffsets.clear();
+            if (offset == mesh.offset && clusters.Has(entity))
+            {
+                CullMeshlets(*clusters.Get(entity).meshlets, mesh.offset, planes, m, vp * m, camera.position, occlusionCulling ? &occlusion : nullptr, rangeOffsets, rangeCounts);
+                if (rangeOffsets.empty())
+                    continue;
+                if (rangeOffsets.size() == 1)
+                {
+                    offset = rangeOffsets[0];
+                    count = (unsigned int)rangeCounts[0];
+                }
+            }
+            auto draw = [&]()
+            {
+                if (rangeOffsets.size() > 1)
+                    list.DrawRanges(mesh.primitive, rangeOffsets.data(), rangeCounts.data(), (unsigned int)rangeOffsets.size());
+                else
+                    list.Draw(mesh.primitive, mesh.iBuffer != 0, offset, count);
+            };
+
+            // Sorted by the center of the bounds, baked models all sit at the origin
+            glm::vec3 center = glm::vec3(m * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+            float depth = glm::max(-(v * glm::vec4(center, 1.0f)).z, 0.0f);
+
+            // Ask for texture detail matching the projected size of the bounds
+            if (material.albedo != 0 && !material.albedoArray)
+            {
+                float radius = glm::length(glm::vec3(m * glm::vec4(box.max - box.min, 0.0f))) * 0.5f;
+                float distance = glm::max(glm::length(center - camera.position) - radius, 0.1f);
+                Engine::Textures().Request(material.albedo, radius * camera.projection[1][1] * packet.viewport.w / distance);
+            }
+
+            // Only solid geometry is laid down early, cutout needs its texture to know its depth
+            bool prePass = depthShader != 0 && mesh.pBuffer != 0 && material.alphaMode == AlphaMode::SOLID;
+            if (prePass)
+            {
+                list.Begin(CommandList::MakeKey(RenderPass::DEPTH, depthShader, 0, depth));
+                list.BindMesh(mesh.pBuffer, mesh.iBuffer);
+                list.BindMaterial(depthShader, 0, false, VertexP::layout);
+                list.SetConstants(m, vp * m);
+                draw();
+                list.End();
+            }
+
+            list.Begin(CommandList::MakeKey((RenderPass)((int)material.alphaMode + 1), material.shader, material.albedo, depth));
+            list.BindMesh(mesh.vBuffer, mesh.iBuffer);
+            list.BindMaterial(material.shader, material.albedo, material.albedoArray, material.layout);
+            list.SetConstants(m, vp * m);
+            draw();
+            list.End();
+        }
+    });
+
+    CommandList::Sort(packet.commandLists, packet.order);
+    Engine::Textures().Update();
+}
+
+void Scene::Submit(const RenderPacket& packet)
 {
+    for (size_t i = 0; i < packet.tasks.size(); i++)
+        packet.tasks[i]();
+
+    Engine::Textures().Upload();
+
+    Graphics::SetViewport(packet.viewport.x, packet.viewport.y, packet.viewport.z, packet.viewport.w);
     Graphics::ClearScreen(true, true, true);
 
-    glm::mat4 v = glm::lookAt(camera.position, camera.position + glm::quat(camera.rotation) * glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
-    
+    DirectionalLight sun = packet.sun;
     int textureLoc = 0;
     glm::vec2 tiling = glm::vec2(1, -1);
 
-    for (size_t i = 0; i < models.size(); i++)
+    // Cached state so consecutive packets sharing a mesh or material skip the rebind
+    Buffer vBuffer = 0;
+    Buffer iBuffer = 0;
+    Shader shader = 0;
+    Texture albedo = 0;
+    Layout layout = 0;
+    RenderPass pass = RenderPass::SOLID;
+    bool prePass = false;
+
+    // Baked geometry shares one identity model matrix, runs of equal constants are uploaded once per shader
+    DrawConstants uploaded;
+    bool constantsValid = false;
+
+    for (size_t i = 0; i < packet.order.size(); i++)
     {
-        Model& model = models[i];
+        const CommandList& list = packet.commandLists[packet.order[i].list];
+        const CommandPacket& commandPacket = list.packets[packet.order[i].packet];
+
+        // After a pre-pass solid geometry only shades the fragments that won, blended geometry never writes depth
+        RenderPass packetPass = CommandList::GetPass(packet.order[i].key);
+        if (packetPass != pass)
+        {
+            prePass |= packetPass == RenderPass::DEPTH;
+            bool equal = prePass && packetPass == RenderPass::SOLID;
+
+            pass = packetPass;
+            Graphics::SetColorWrite(pass != RenderPass::DEPTH);
+            Graphics::SetDepthFunc(equal ? DepthFunc::EQUAL : DepthFunc::LESS);
+            Graphics::SetDepthWrite(!equal && pass != RenderPass::BLEND);
+            Graphics::SetBlend(pass == RenderPass::BLEND);
+        }
 
-        glm::mat4 m = glm::translate(glm::mat4(1), model.transform.position) * glm::mat4(glm::quat(glm::radians(model.transform.rotation))) * glm::scale(glm::mat4(1), model.transform.scale);
-        glm::mat4 mvp = camera.projection * v * m;
+        for (unsigned int j = commandPacket.first; j < commandPacket.first + commandPacket.count; j++)
+        {
+            const Command& command = list.commands[j];
+            switch (command.type)
+            {
+            case CommandType::BIND_MESH:
+            {
+                bool meshChanged = command.bindMesh.vBuffer != vBuffer;
+                if (meshChanged)
+                    Graphics::BindBuffer(vBuffer = command.bindMesh.vBuffer, false);
+                if (command.bindMesh.iBuffer != 0 && command.bindMesh.iBuffer != iBuffer)
+                    Graphics::BindBuffer(iBuffer = command.bindMesh.iBuffer, true);
 
-        Graphics::BindBuffer(model.mesh.vBuffer, false);
-        if (model.mesh.iBuffer != 0)
-            Graphics::BindBuffer(model.mesh.iBuffer, true);
+                // Attribute pointers capture the bound vertex buffer, so they have to be set again
+                if (meshChanged)
+                    layout = 0;
+                break;
+            }
+            case CommandType::BIND_MATERIAL:
+            {
+                const BindMaterialCommand& material = command.bindMaterial;
+                if (material.shader != shader || material.layout != layout)
+                {
+                    Graphics::BindShader(material.shader, material.layout);
+                    layout = material.layout;
+                }
 
-        Graphics::BindShader(model.material.shader, model.material.attributeFormat);
+                if (material.shader != shader)
+                {
+                    shader = material.shader;
+                    constantsValid = false;
+                    Graphics::SetUniform(shader, "SunDirection", 1, &sun.direction);
+                    Graphics::SetUniform(shader, "SunColor", 1, &sun.color);
+                    Graphics::SetUniform(shader, "SunIntensity", 1, &sun.intensisty);
+                    Graphics::SetUniform(shader, "Texture", 1, &textureLoc);
+                    Graphics::SetUniform(shader, "Tiling", 1, &tiling);
+                }
 
-        if (model.material.albedo != 0)
-            Graphics::BindTexture(model.material.albedo, textureLoc);
+                if (material.albedo != albedo)
+                {
+                    if (material.albedo == 0)
+                        Graphics::DetachTexture();
+                    else if (material.albedoArray)
+                        Graphics::BindTextureArray(material.albedo, textureLoc);
+                    else
+                        Graphics::BindTexture(material.albedo, textureLoc);
+                    albedo = material.albedo;
+                }
+                break;
+            }
+            case CommandType::SET_CONSTANTS:
+            {
+                DrawConstants constants = list.constants[command.setConstants.index];
+                if (constantsValid && constants.model == uploaded.model && constants.mvp == uploaded.mvp)
+                    break;
 
-        Graphics::SetUniform(model.material.shader, "Model", 1, &m);
-        Graphics::SetUniform(model.material.shader, "MVP", 1, &mvp);
-        Graphics::SetUniform(model.material.shader, "SunDirection", 1, &sun.direction);
-        Graphics::SetUniform(model.material.shader, "SunColor", 1, &sun.color);
-        Graphics::SetUniform(model.material.shader, "SunIntensity", 1, &sun.intensisty);
+                Graphics::SetUniform(shader, "Model", 1, &constants.model);
+                Graphics::SetUniform(shader, "MVP", 1, &constants.mvp);
+                uploaded = constants;
+                constantsValid = true;
+                break;
+            }
+            case CommandType::DRAW:
+            {
+                const DrawCommand& draw = command.draw;
+                if (draw.indexed)
+                    Graphics::DrawIndexed(draw.primitive, draw.offset, draw.count);
+                else
+                    Graphics::DrawVertices(draw.primitive, draw.offset, draw.count);
+                break;
+            }
+            case CommandType::DRAW_RANGES:
+            {
+                const DrawRangesCommand& draw = command.drawRanges;
+                Graphics::DrawIndexedRanges(draw.primitive, &list.rangeOffsets[draw.first], &list.rangeCounts[draw.first], draw.count);
+                break;
+            }
+            }
+        }
+    }
 
-        Graphics::SetUniform(model.material.shader, "Texture", 1, &textureLoc);
-        Graphics::SetUniform(model.material.shader, "Tiling", 1, &tiling);
-        
-        if (model.mesh.iBuffer != 0)
-            Graphics::DrawIndexed(Primitive::TRIANGLES, model.mesh.count);
-        else
-            Graphics::DrawVertices(Primitive::TRIANGLES, 0, model.mesh.count);
+    if (pass != RenderPass::SOLID || prePass)
+    {
+        Graphics::SetColorWrite(true);
+        Graphics::SetDepthFunc(DepthFunc::LESS);
+        Graphics::SetDepthWrite(true);
+        Graphics::SetBlend(false);
+    }
 
-        Graphics::DetachTexture();
-        Graphics::DetachShader();
-        Graphics::DetachBuffer();
+    Graphics::DetachTexture();
+    Graphics::DetachShader();
+    Graphics::DetachBuffer();
+}
+
+void AdaptVSync(sf::Window& window, const LoopSettings& loop, sf::Time work, bool& vsync)
+{
+    if (loop.vsync != VSync::ADAPTIVE)
+        return;
+
+    // Hysteresis keeps v-sync from toggling every frame around the threshold
+    sf::Time refreshInterval = sf::seconds(1.0f / loop.refreshRate);
+    if (vsync && work > refreshInterval)
+        window.setVerticalSyncEnabled(vsync = false);
+    else if (!vsync && work < refreshInterval * 0.85f)
+        window.setVerticalSyncEnabled(vsync = true);
+}
+
+void RenderThread::Start(sf::RenderWindow& window, const LoopSettings& loop)
+{
+    pWindow = &window;
+    this->loop = loop;
+    writeIndex = 0;
+    pending = false;
+    running = true;
+
+    // The render thread owns the GL context from here on
+    window.setActive(false);
+    thread = std::thread(&RenderThread::Run, this);
+}
+
+void RenderThread::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
     }
+    condition.notify_all();
+
+    if (thread.joinable())
+        thread.join();
 }
 
-int Engine::Run(IApplication* pApp, const std::string& title, int width, int height, const sf::ContextSettings& settings)
+RenderPacket& RenderThread::Acquire()
+{
+    return packets[writeIndex];
+}
+
+void RenderThread::Present()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !pending; });
+
+    writeIndex ^= 1;
+    pending = true;
+    condition.notify_all();
+}
+
+void RenderThread::Run()
+{
+    pWindow->setActive(true);
+
+    bool vsync = loop.vsync != VSync::OFF;
+    sf::Clock workClock;
+    while (true)
+    {
+        int readIndex;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return pending || !running; });
+            if (!pending)
+                break;
+
+            readIndex = writeIndex ^ 1;
+        }
+
+        workClock.restart();
+        Scene::Submit(packets[readIndex]);
+        AdaptVSync(*pWindow, loop, workClock.getElapsedTime(), vsync);
+        pWindow->display();
+        Graphics::EndFrame();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = false;
+        }
+        condition.notify_all();
+    }
+
+    pWindow->setActive(false);
+}
+
+std::vector<std::function<void()>>& DeferredTasks()
+{
+    static std::vector<std::function<void()>> tasks;
+    return tasks;
+}
+
+void PaceFrame(const sf::Clock& frameClock, sf::Time target)
+{
+    // Sleep for the bulk of the wait and spin the rest, sf::sleep is only accurate to about a millisecond
+    sf::Time remaining = target - frameClock.getElapsedTime();
+    if (remaining > sf::milliseconds(2))
+        sf::sleep(remaining - sf::milliseconds(1));
+
+    while (frameClock.getElapsedTime() < target);
+}
+
+int Engine::Run(IApplication* pApp, const std::string& title, int width, int height, const sf::ContextSettings& settings, const LoopSettings& loop)
 {
     // Create the window
     sf::RenderWindow window(sf::VideoMode(width, height), title.c_str(), sf::Style::Default, settings);
@@ -64,24 +694,58 @@ int Engine::Run(IApplication* pApp, const std::string& title, int width, int hei
 
     window.setActive(true);
     Graphics::Initialize();
+    Jobs().Start(loop.jobWorkers);
+
+    bool vsync = loop.vsync != VSync::OFF;
+    window.setVerticalSyncEnabled(vsync);
 
+    // Whatever Initialize got to create still goes through the regular shutdown
     if (!pApp->Initialize(window))
+    {
+        std::vector<std::function<void()>> tasks;
+        tasks.swap(DeferredTasks());
+        for (size_t i = 0; i < tasks.size(); i++)
+            tasks[i]();
+
+        Shaders().Clear();
+        Textures().Release();
+        Graphics::Shutdown();
+        window.setActive(false);
+        window.close();
+
+        Jobs().Stop();
         return EXIT_FAILURE;
+    }
+
+    const sf::Time step = sf::seconds(1.0f / loop.stepRate);
+    const sf::Time frameTarget = loop.frameRate > 0 ? sf::seconds(1.0f / loop.frameRate) : sf::Time::Zero;
 
+    RenderPacket packet;
+    RenderThread renderThread;
+    if (loop.renderThread)
+        renderThread.Start(window, loop);
+
+    bool running = true;
     int frames = 0;
     float timer = 0;
+    sf::Time accumulator;
     sf::Clock deltaClock;
-    while (window.isOpen())
+    sf::Clock frameClock;
+    while (running)
     {
+        frameClock.restart();
+
         sf::Event event;
         while (window.pollEvent(event))
         {
             if (event.type == sf::Event::Closed)
-                window.close();
+                running = false;
 
             pApp->Input(event);
         }
 
+        Files().Poll();
+
         sf::Time dt = deltaClock.restart();
         timer += dt.asSeconds();
         if (timer >= 1)
@@ -91,16 +755,105 @@ int Engine::Run(IApplication* pApp, const std::string& title, int width, int hei
             frames = 0;
         }
 
-        pApp->Update(dt);
+        if (loop.fixedStep)
+        {
+            accumulator += dt;
+
+            int steps = 0;
+            while (accumulator >= step && steps < loop.maxSteps)
+            {
+                pApp->Update(step);
+                accumulator -= step;
+                steps++;
+            }
 
-        pApp->Render();
-        window.display();
+            // Too far behind to catch up, drop the backlog rather than spiral
+            if (accumulator >= step)
+                accumulator = accumulator % step;
+
+            pApp->Interpolate(accumulator / step);
+        }
+        else
+        {
+            pApp->Update(dt);
+            pApp->Interpolate(1.0f);
+        }
+
+        // Deferred work rides with this frame's packet, so it runs once the packets before it are done
+        RenderPacket& target = loop.renderThread ? renderThread.Acquire() : packet;
+        target.tasks.clear();
+        target.tasks.swap(DeferredTasks());
+
+        if (loop.renderThread)
+        {
+            pApp->Render(target);
+            renderThread.Present();
+        }
+        else
+        {
+            pApp->Render(packet);
+            Scene::Submit(packet);
+            AdaptVSync(window, loop, frameClock.getElapsedTime(), vsync);
+            window.display();
+            Graphics::EndFrame();
+        }
+
+        if (frameTarget > sf::Time::Zero)
+            PaceFrame(frameClock, frameTarget);
 
         frames++;
     }
 
+    // Take the context back so the application can release its resources
+    if (loop.renderThread)
+    {
+        renderThread.Stop();
+        window.setActive(true);
+    }
+
+    // Work deferred during the last frame still has to run, resources may be waiting on it to be released
+    packet.tasks.clear();
+    packet.tasks.swap(DeferredTasks());
+    for (size_t i = 0; i < packet.tasks.size(); i++)
+        packet.tasks[i]();
+
     pApp->Clean();
+    Shaders().Clear();
+    Textures().Release();
+    Graphics::Shutdown();
     window.setActive(false);
+    window.close();
+
+    Jobs().Stop();
 
     return EXIT_SUCCESS;
+}
+
+JobSystem& Engine::Jobs()
+{
+    static JobSystem jobs;
+    return jobs;
+}
+
+TextureStreamer& Engine::Textures()
+{
+    static TextureStreamer textures;
+    return textures;
+}
+
+ShaderCache& Engine::Shaders()
+{
+    static ShaderCache shaders;
+    return shaders;
+}
+
+FileWatcher& Engine::Files()
+{
+    static FileWatcher files;
+    return files;
+}
+
+void Engine::Defer(const std::function<void()>& task)
+{
+    DeferredTasks().push_back(task);
 }
\ No newline at end of file
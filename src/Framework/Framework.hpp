@@ -6,9 +6,22 @@
 #include <SFML/Graphics.hpp>
 
 #include <Framework/Graphics.hpp>
+#include <Framework/Commands.hpp>
+#include <Framework/Entities.hpp>
+#include <Framework/FileWatcher.hpp>
+#include <Framework/Jobs.hpp>
+#include <Framework/Meshlets.hpp>
+#include <Framework/OcclusionBuffer.hpp>
+#include <Framework/ShaderCache.hpp>
+#include <Framework/TextureStreamer.hpp>
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
 
 struct Camera
 {
@@ -27,7 +40,7 @@ struct DirectionalLight
 
 struct VertexPNCT
 {
-	static const std::vector<AttributeFormat> format;
+	static const Layout layout;
 
 	glm::vec3 position = glm::vec3(0);
 	glm::vec3 normal = glm::vec3(0);
@@ -35,21 +48,59 @@ struct VertexPNCT
 	glm::vec2 texcoord = glm::vec2(0);
 };
 
+// Position only stream for depth passes
+struct VertexP
+{
+	static const Layout layout;
+
+	glm::vec3 position = glm::vec3(0);
+};
+
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(0);
+	glm::vec3 max = glm::vec3(0);
+};
+
+// Simplified index range of a mesh, error is how far it strays from the full mesh in model space
+struct MeshLod
+{
+	unsigned int offset = 0;
+	unsigned int count = 0;
+	float error = 0.0f;
+};
+
 struct Mesh
 {
+	static const int maxLods = 3;
+
 	Primitive primitive = Primitive::TRIANGLES;
 	Buffer vBuffer = 0;
 	Buffer iBuffer = 0;
+	Buffer pBuffer = 0;
+	// First index, or first vertex without an index buffer, baked meshes sit side by side in shared buffers
+	unsigned int offset = 0;
 	unsigned int count = 0;
+
+	// Coarser levels in the same buffers, from finest to coarsest
+	MeshLod lods[maxLods];
+	int lodCount = 0;
+
+	// CPU copy of the full level for big solid meshes, drawn into the occlusion buffer
+	Occluder occluder = 0;
+	// Clusters of the full level for large meshes, culled one by one before drawing
+	MeshletSet meshlets = 0;
 };
 
 struct Material
 {
-	std::vector<AttributeFormat> attributeFormat;
+	Layout layout = 0;
 	Shader shader = 0;
 	
 	glm::vec3 diffuse = glm::vec3(1);
 	Texture albedo = 0;
+	bool albedoArray = false;
+	AlphaMode alphaMode = AlphaMode::SOLID;
 };
 
 struct Transform
@@ -64,16 +115,134 @@ struct Model
 	Transform transform;
 	Material material;
 	Mesh mesh;
+	Bounds bounds;
+};
+
+// Meshlets of an entity's mesh, the shared copy keeps them alive while the import that made them is released
+struct Clusters
+{
+	std::shared_ptr<const std::vector<Meshlet>> meshlets;
+};
+
+// Level an entity was drawn at, 0 is the full mesh. Kept between frames so levels only change past a margin
+struct LodState
+{
+	int level = 0;
+};
+
+// Models are plain handles and values, scenes copy and sort them freely
+static_assert(std::is_trivially_copyable<Model>::value, "Model must stay trivially copyable");
+
+// Everything the GL side needs to draw one frame, built on the main thread and only read once submitted
+struct RenderPacket
+{
+	glm::ivec4 viewport = glm::ivec4(0);
+	DirectionalLight sun;
+
+	// Recorded in parallel over disjoint model ranges, replayed in key order
+	std::vector<CommandList> commandLists;
+	std::vector<CommandRef> order;
+
+	// GL work deferred by the main thread, run before the packet is drawn
+	std::vector<std::function<void()>> tasks;
+};
+
+// Parents always come before their children in the flat hierarchy, so one forward pass updates every world matrix
+struct SceneNode
+{
+	Entity entity = 0;
+	// Index + 1 of the parent node, 0 for roots
+	unsigned int parent = 0;
+	bool isStatic = false;
 };
 
 class Scene
 {
 public:
-	void Render();
+	// Splits the model into components, the entity stays valid until destroyed whatever else comes and goes.
+	// Transforms are relative to the parent, children of a static node start out static
+	Entity Spawn(const Model& model, Entity parent = 0);
+	Entity Spawn(const Transform& transform, Entity parent = 0);
+	Entity Spawn(const DirectionalLight& light);
+	// Takes the entity's children with it
+	void Destroy(Entity entity);
+	void Clear();
+
+	// Static subtrees are baked on the next update and skipped after that, set them again after moving them
+	void SetStatic(Entity entity, bool isStatic);
+
+	// Main thread before Build, brings world matrices up to date with the transforms
+	void UpdateTransforms();
+	const glm::mat4& GetWorld(Entity entity) const;
+
+	// Main thread after UpdateTransforms, picks the coarsest level whose error stays within lodPixelError on screen
+	void SelectLods(const glm::ivec4& viewport);
+
+	// Main thread before Build, rasterizes the occluders in view so Build can skip what they hide
+	void UpdateOcclusion(const glm::ivec4& viewport);
+
+	void Build(RenderPacket& packet) const;
+	static void Submit(const RenderPacket& packet);
 
 	Camera camera;
-	DirectionalLight sun;
-	std::vector<Model> models;
+
+	// Models spawn into transforms, meshes, materials and bounds together, so the four stay in the same order
+	EntityPool entities;
+	ComponentPool<Transform> transforms;
+	ComponentPool<Mesh> meshes;
+	ComponentPool<Material> materials;
+	ComponentPool<Bounds> bounds;
+	// Entities whose mesh has simplified levels
+	ComponentPool<LodState> lodStates;
+	// Entities whose mesh is split into meshlets
+	ComponentPool<Clusters> clusters;
+	// Only the first light shades the scene
+	ComponentPool<DirectionalLight> lights;
+
+	// Lays down depth for solid geometry first so the lit pass shades each pixel once, 0 disables it
+	Shader depthShader = 0;
+
+	// Screen space error in pixels a level may show, coarser levels wait until they are well inside it
+	float lodPixelError = 1.0f;
+	float lodHysteresis = 0.75f;
+
+	// Width of the occlusion buffer in pixels, the height follows the viewport's aspect. 0 turns occlusion culling off
+	int occlusionWidth = 256;
+
+private:
+	void Release(Entity entity);
+
+	// World matrices sit next to their nodes, destroyed nodes keep entity 0 until the next update compacts them
+	std::vector<SceneNode> nodes;
+	std::vector<glm::mat4> worlds;
+	std::vector<unsigned int> dynamicNodes;
+	ComponentPool<unsigned int> nodeIndices;
+	bool hierarchyChanged = false;
+
+	OcclusionBuffer occlusion;
+};
+
+enum struct VSync { OFF, ON, ADAPTIVE };
+
+struct LoopSettings
+{
+	// Run Update at stepRate and interpolate between the last two states when rendering
+	bool fixedStep = false;
+	float stepRate = 60.0f;
+	int maxSteps = 5;
+
+	// ADAPTIVE drops v-sync while a frame's work exceeds the refresh interval instead of halving the rate
+	VSync vsync = VSync::ON;
+	float refreshRate = 60.0f;
+
+	// Frame pacing target, 0 leaves the frame rate uncapped
+	float frameRate = 0.0f;
+
+	// Submit GL work from a dedicated thread so simulating frame N+1 overlaps submitting frame N
+	bool renderThread = false;
+
+	// Job system workers, below zero uses one per spare hardware thread
+	int jobWorkers = -1;
 };
 
 class IApplication
@@ -84,12 +253,49 @@ public:
 	virtual bool Initialize(sf::RenderWindow& window) = 0;
 	virtual void Input(const sf::Event& e) = 0;
 	virtual void Update(const sf::Time& deltaTime) = 0;
-	virtual void Render() = 0;
+	virtual void Interpolate(float /*alpha*/) {}
+	virtual void Render(RenderPacket& packet) = 0;
 	virtual void Clean() = 0;
 };
 
+class RenderThread
+{
+public:
+	void Start(sf::RenderWindow& window, const LoopSettings& loop);
+	void Stop();
+
+	// Packet the main thread may fill while the previous one is being submitted
+	RenderPacket& Acquire();
+
+	// Hands the acquired packet over, waiting for the render thread to finish the one before it
+	void Present();
+
+private:
+	void Run();
+
+	sf::RenderWindow* pWindow = nullptr;
+	LoopSettings loop;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	RenderPacket packets[2];
+	int writeIndex = 0;
+	bool pending = false;
+	bool running = false;
+};
+
 class Engine
 {
 public:
-	static int Run(IApplication* pApp, const std::string& title, int width, int height, const sf::ContextSettings& settings);
+	static int Run(IApplication* pApp, const std::string& title, int width, int height, const sf::ContextSettings& settings, const LoopSettings& loop = LoopSettings());
+
+	static JobSystem& Jobs();
+	static TextureStreamer& Textures();
+	static ShaderCache& Shaders();
+	static FileWatcher& Files();
+
+	// Main thread, runs the task on the GL thread ahead of the next frame, after every frame recorded before it
+	static void Defer(const std::function<void()>& task);
 };
\ No newline at end of file
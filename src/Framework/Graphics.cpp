@@ -3,10 +3,96 @@
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <SFML/Window/Context.hpp>
+
+#include <algorithm>
+#include <deque>
 #include <iostream>
+#include <mutex>
 
 #define ASSERT(expr) assert(expr)
 
+// KHR_debug is not part of the 3.3 core loader, so its entry points are fetched at runtime
+#define GL_DEBUG_SOURCE_API 0x8246
+#define GL_DEBUG_SOURCE_WINDOW_SYSTEM 0x8247
+#define GL_DEBUG_SOURCE_SHADER_COMPILER 0x8248
+#define GL_DEBUG_SOURCE_THIRD_PARTY 0x8249
+#define GL_DEBUG_SOURCE_APPLICATION 0x824A
+#define GL_DEBUG_SOURCE_OTHER 0x824B
+#define GL_DEBUG_TYPE_ERROR 0x824C
+#define GL_DEBUG_SEVERITY_NOTIFICATION 0x826B
+#define GL_DEBUG_SEVERITY_HIGH 0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+#define GL_DEBUG_SEVERITY_LOW 0x9148
+#define GL_DEBUG_OUTPUT 0x92E0
+
+typedef void (APIENTRY* GLDEBUGPROCKHR)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
+typedef void (APIENTRYP PFNGLDEBUGMESSAGECALLBACKKHRPROC)(GLDEBUGPROCKHR callback, const void* userParam);
+typedef void (APIENTRYP PFNGLDEBUGMESSAGECONTROLKHRPROC)(GLenum source, GLenum type, GLenum severity, GLsizei count, const GLuint* ids, GLboolean enabled);
+
+// ARB_get_program_binary is core from 4.1 only
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYARBPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYARBPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIARBPROC)(GLuint program, GLenum pname, GLint value);
+
+static PFNGLGETPROGRAMBINARYARBPROC glGetProgramBinaryARB = nullptr;
+static PFNGLPROGRAMBINARYARBPROC glProgramBinaryARB = nullptr;
+static PFNGLPROGRAMPARAMETERIARBPROC glProgramParameteriARB = nullptr;
+
+static PFNGLDEBUGMESSAGECALLBACKKHRPROC glDebugMessageCallbackKHR = nullptr;
+static PFNGLDEBUGMESSAGECONTROLKHRPROC glDebugMessageControlKHR = nullptr;
+
+static ErrorCheck errorCheck = ErrorCheck::NONE;
+static DebugSeverity debugSeverity = DebugSeverity::LOW;
+static bool debugSources[] = { true, true, true, true, true, true };
+
+// Attribute arrays left enabled by the last bound shader
+static unsigned int enabledAttributes = 0;
+
+static const GLenum debugSourceEnums[] = { GL_DEBUG_SOURCE_API, GL_DEBUG_SOURCE_WINDOW_SYSTEM, GL_DEBUG_SOURCE_SHADER_COMPILER, GL_DEBUG_SOURCE_THIRD_PARTY, GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_SOURCE_OTHER };
+static const GLenum debugSeverityEnums[] = { GL_DEBUG_SEVERITY_NOTIFICATION, GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_HIGH };
+
+// Buffers, shaders and textures are handed out as generational handles over dense pools of GL names.
+// The low bits pick the slot and the high bits count how often it was reused, so a stale handle trips
+// an assert instead of reaching whatever took its slot. Pools are only touched on the GL thread
+static const unsigned int slotBits = 20;
+static const unsigned int slotMask = (1u << slotBits) - 1;
+static const unsigned int generationMask = (1u << (32 - slotBits)) - 1;
+
+struct ResourcePool
+{
+    explicit ResourcePool(const char* type)
+        : type(type)
+    {}
+
+    const char* type;
+    std::vector<GLuint> names;
+    std::vector<unsigned int> generations;
+    std::vector<unsigned int> freeSlots;
+    // Deleted handles wait here until the end of the frame, commands recorded earlier may still use them
+    std::vector<unsigned int> pending;
+    size_t live = 0;
+};
+
+static ResourcePool buffers("buffer");
+static ResourcePool shaders("shader");
+static ResourcePool textures("texture");
+
+// S3TC and BPTC are extensions to the 3.3 core profile, RGTC is core
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+
+// Release builds compile the synchronous check out entirely
+#ifdef NDEBUG
+#define CHECK_GL_ERROR()
+#else
+#define CHECK_GL_ERROR() ASSERT(errorCheck != ErrorCheck::SYNCHRONOUS || CheckGLError())
+#endif
+
 bool CheckGLError()
 {
     GLenum err;
@@ -22,7 +108,76 @@ bool CheckGLError()
     return true;
 }
 
-bool CheckShaderStatus(Shader shader, bool linked)
+unsigned int AddResource(ResourcePool& pool, GLuint name)
+{
+    ASSERT(name != 0);
+
+    unsigned int slot;
+    if (!pool.freeSlots.empty())
+    {
+        slot = pool.freeSlots.back();
+        pool.freeSlots.pop_back();
+        pool.names[slot] = name;
+    }
+    else
+    {
+        slot = (unsigned int)pool.names.size();
+        ASSERT(slot < slotMask);
+        pool.names.push_back(name);
+        pool.generations.push_back(0);
+    }
+
+    ++pool.live;
+    return (pool.generations[slot] << slotBits) | (slot + 1);
+}
+
+GLuint GetResource(const ResourcePool& pool, unsigned int handle)
+{
+    unsigned int slot = (handle & slotMask) - 1;
+    ASSERT(slot < pool.names.size());
+    ASSERT(pool.generations[slot] == handle >> slotBits && pool.names[slot] != 0);
+    return pool.names[slot];
+}
+
+void RemoveResource(ResourcePool& pool, unsigned int handle)
+{
+    GetResource(pool, handle);
+    pool.pending.push_back(handle);
+}
+
+// Frees the slots of pending handles and hands back their names for the matching glDelete call
+void ReleaseResources(ResourcePool& pool, std::vector<GLuint>& names)
+{
+    names.clear();
+    for (size_t i = 0; i < pool.pending.size(); ++i)
+    {
+        unsigned int slot = (pool.pending[i] & slotMask) - 1;
+        // A mismatch here means the same handle was deleted twice
+        ASSERT(pool.generations[slot] == pool.pending[i] >> slotBits);
+        names.push_back(pool.names[slot]);
+        pool.names[slot] = 0;
+        pool.generations[slot] = (pool.generations[slot] + 1) & generationMask;
+        pool.freeSlots.push_back(slot);
+        --pool.live;
+    }
+    pool.pending.clear();
+}
+
+void ReportLeaks(const ResourcePool& pool)
+{
+    if (pool.live == 0)
+        return;
+
+    std::cerr << "Leaked " << pool.live << " " << pool.type << " handle(s):";
+    for (size_t slot = 0; slot < pool.names.size(); ++slot)
+    {
+        if (pool.names[slot] != 0)
+            std::cerr << " " << ((pool.generations[slot] << slotBits) | (unsigned int)(slot + 1));
+    }
+    std::cerr << std::endl;
+}
+
+bool CheckShaderStatus(GLuint shader, bool linked)
 {
     ASSERT(shader != 0);
 
@@ -51,37 +206,177 @@ bool CheckShaderStatus(Shader shader, bool linked)
     return success;
 }
 
+const char* DebugSourceName(GLenum source)
+{
+    switch (source)
+    {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "WINDOW_SYSTEM";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "SHADER_COMPILER";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "THIRD_PARTY";
+    case GL_DEBUG_SOURCE_APPLICATION: return "APPLICATION";
+    default: return "OTHER";
+    }
+}
+
+const char* DebugSeverityName(GLenum severity)
+{
+    switch (severity)
+    {
+    case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
+    case GL_DEBUG_SEVERITY_LOW: return "LOW";
+    default: return "NOTIFICATION";
+    }
+}
+
+void APIENTRY DebugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei /*length*/, const GLchar* message, const void* /*userParam*/)
+{
+    std::ostream& out = type == GL_DEBUG_TYPE_ERROR ? std::cerr : std::cout;
+    out << "GL_DEBUG [" << DebugSourceName(source) << "|" << DebugSeverityName(severity) << "] " << id << ": " << message << std::endl;
+}
+
+void ApplyDebugFilter()
+{
+    if (glDebugMessageControlKHR == nullptr)
+        return;
+
+    glDebugMessageControlKHR(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+    for (int i = 0; i < 6; ++i)
+    {
+        if (!debugSources[i])
+            continue;
+
+        for (int j = (int)debugSeverity; j < 4; ++j)
+            glDebugMessageControlKHR(debugSourceEnums[i], GL_DONT_CARE, debugSeverityEnums[j], 0, nullptr, GL_TRUE);
+    }
+}
+
 void Graphics::Initialize()
 {
     gladLoadGL();
+
+    if (sf::Context::isExtensionAvailable("GL_KHR_debug"))
+    {
+        glDebugMessageCallbackKHR = (PFNGLDEBUGMESSAGECALLBACKKHRPROC)sf::Context::getFunction("glDebugMessageCallback");
+        glDebugMessageControlKHR = (PFNGLDEBUGMESSAGECONTROLKHRPROC)sf::Context::getFunction("glDebugMessageControl");
+    }
+
+    if (sf::Context::isExtensionAvailable("GL_ARB_get_program_binary"))
+    {
+        glGetProgramBinaryARB = (PFNGLGETPROGRAMBINARYARBPROC)sf::Context::getFunction("glGetProgramBinary");
+        glProgramBinaryARB = (PFNGLPROGRAMBINARYARBPROC)sf::Context::getFunction("glProgramBinary");
+        glProgramParameteriARB = (PFNGLPROGRAMPARAMETERIARBPROC)sf::Context::getFunction("glProgramParameteri");
+    }
+
+#ifdef NDEBUG
+    SetErrorCheck(ErrorCheck::NONE);
+#else
+    if (!SetErrorCheck(ErrorCheck::DEBUG_OUTPUT))
+        SetErrorCheck(ErrorCheck::SYNCHRONOUS);
+#endif
+}
+
+void Graphics::EndFrame()
+{
+    static std::vector<GLuint> names;
+
+    ReleaseResources(buffers, names);
+    if (!names.empty())
+        glDeleteBuffers((GLsizei)names.size(), names.data());
+
+    ReleaseResources(textures, names);
+    if (!names.empty())
+        glDeleteTextures((GLsizei)names.size(), names.data());
+
+    ReleaseResources(shaders, names);
+    for (size_t i = 0; i < names.size(); ++i)
+        glDeleteProgram(names[i]);
+
+    CHECK_GL_ERROR();
+}
+
+void Graphics::Shutdown()
+{
+    EndFrame();
+
+    // Anything still alive was never deleted, the context takes the objects with it
+    ReportLeaks(buffers);
+    ReportLeaks(shaders);
+    ReportLeaks(textures);
+}
+
+bool Graphics::SetErrorCheck(ErrorCheck mode)
+{
+    bool debugOutput = glDebugMessageCallbackKHR != nullptr && glDebugMessageControlKHR != nullptr;
+    if (mode == ErrorCheck::DEBUG_OUTPUT && !debugOutput)
+        return false;
+
+    if (debugOutput)
+    {
+        if (mode == ErrorCheck::DEBUG_OUTPUT)
+        {
+            glDebugMessageCallbackKHR(DebugMessageCallback, nullptr);
+            ApplyDebugFilter();
+            glEnable(GL_DEBUG_OUTPUT);
+        }
+        else
+        {
+            glDisable(GL_DEBUG_OUTPUT);
+            glDebugMessageCallbackKHR(nullptr, nullptr);
+        }
+    }
+
+    // Drop errors raised before the switch so the synchronous check starts clean
+    while (glGetError() != GL_NO_ERROR);
+
+    errorCheck = mode;
+    return true;
+}
+
+ErrorCheck Graphics::GetErrorCheck()
+{
+    return errorCheck;
+}
+
+void Graphics::SetDebugSeverity(DebugSeverity minimum)
+{
+    debugSeverity = minimum;
+    ApplyDebugFilter();
+}
+
+void Graphics::SetDebugSource(DebugSource source, bool enable)
+{
+    debugSources[(int)source] = enable;
+    ApplyDebugFilter();
 }
 
 void Graphics::SetViewport(float x, float y, float width, float height)
 {
     glViewport(x, y, width, height);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetClearColor(float r, float g, float b, float a)
 {
     glClearColor(r, g, b, a);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetClearDepth(float depth)
 {
     glClearDepth(depth);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetClearStencil(unsigned int mask)
 {
     glStencilMask(mask);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::ClearScreen(bool color, bool depth, bool stencil)
@@ -92,7 +387,7 @@ void Graphics::ClearScreen(bool color, bool depth, bool stencil)
     mask |= stencil ? GL_STENCIL_BUFFER_BIT : 0;
     glClear(mask);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetCull(bool enable)
@@ -102,7 +397,7 @@ void Graphics::SetCull(bool enable)
     else
         glDisable(GL_CULL_FACE);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetCullFace(CullFace face)
@@ -114,7 +409,7 @@ void Graphics::SetCullFace(CullFace face)
     case CullFace::BOTH: glCullFace(GL_FRONT_AND_BACK); break;
     }
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetFaceWinding(bool ccw)
@@ -124,7 +419,7 @@ void Graphics::SetFaceWinding(bool ccw)
     else
         glFrontFace(GL_CW);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetBlend(bool enable)
@@ -134,7 +429,7 @@ void Graphics::SetBlend(bool enable)
     else
         glDisable(GL_BLEND);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetBlendFunc(BlendFunc func)
@@ -146,7 +441,7 @@ void Graphics::SetBlendFunc(BlendFunc func)
     case BlendFunc::INTERPOLATE: glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); break;
     }
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetDepthTest(bool enable)
@@ -156,14 +451,21 @@ void Graphics::SetDepthTest(bool enable)
     else
         glDisable(GL_DEPTH_TEST);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetDepthWrite(bool enable)
 {
     glDepthMask(enable);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
+}
+
+void Graphics::SetColorWrite(bool enable)
+{
+    glColorMask(enable, enable, enable, enable);
+
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetDepthFunc(DepthFunc func)
@@ -180,7 +482,7 @@ void Graphics::SetDepthFunc(DepthFunc func)
     case DepthFunc::ALWAYS: glDepthFunc(GL_ALWAYS); break;
     }
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetSmoothing(bool enable)
@@ -196,12 +498,14 @@ void Graphics::SetSmoothing(bool enable)
         glDisable(GL_POLYGON_SMOOTH);
     }
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 Buffer Graphics::CreateBuffer(int bufferCount, int dataCount, const void* data, bool index, bool dynamic)
 {
-    Buffer buffer;
+    ASSERT(bufferCount == 1);
+
+    GLuint buffer;
     glGenBuffers(bufferCount, &buffer);
     if (index)
     {
@@ -216,17 +520,15 @@ Buffer Graphics::CreateBuffer(int bufferCount, int dataCount, const void* data,
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
-    ASSERT(CheckGLError());
-    return buffer;
+    CHECK_GL_ERROR();
+    return AddResource(buffers, buffer);
 }
 
 void Graphics::DeleteBuffer(int count, Buffer buffer)
 {
+    ASSERT(count == 1);
     ASSERT(buffer != 0);
-    glDeleteBuffers(count, &buffer);
-    buffer = 0;
-
-    ASSERT(CheckGLError());
+    RemoveResource(buffers, buffer);
 }
 
 void Graphics::UpdateBuffer(Buffer buffer, int count, const void* data, bool index)
@@ -234,7 +536,7 @@ void Graphics::UpdateBuffer(Buffer buffer, int count, const void* data, bool ind
     ASSERT(buffer != 0);
     // TODO
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::BindBuffer(Buffer buffer, bool index)
@@ -242,11 +544,11 @@ void Graphics::BindBuffer(Buffer buffer, bool index)
     ASSERT(buffer != 0);
 
     if (index)
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GetResource(buffers, buffer));
     else
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, GetResource(buffers, buffer));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::DetachBuffer()
@@ -254,7 +556,7 @@ void Graphics::DetachBuffer()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 Shader Graphics::CreateShader(const char* vSrc, const char* pSrc, const char* gSrc)
@@ -262,131 +564,328 @@ Shader Graphics::CreateShader(const char* vSrc, const char* pSrc, const char* gS
     ASSERT(vSrc != nullptr);
     ASSERT(pSrc != nullptr);
 
-    Shader vShader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vShader, 1, &vSrc, NULL);
     glCompileShader(vShader);
     ASSERT(CheckShaderStatus(vShader, false));
 
-    Shader pShader = glCreateShader(GL_FRAGMENT_SHADER);
+    GLuint pShader = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(pShader, 1, &pSrc, NULL);
     glCompileShader(pShader);
     ASSERT(CheckShaderStatus(pShader, false));
 
-    Shader program = glCreateProgram();
+    GLuint program = glCreateProgram();
     glAttachShader(program, vShader);
     glAttachShader(program, pShader);
+    if (IsShaderBinarySupported())
+        glProgramParameteriARB(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
     ASSERT(CheckShaderStatus(program, true));
 
     glDeleteShader(vShader);
     glDeleteShader(pShader);
 
-    ASSERT(CheckGLError());
-    return program;
+    CHECK_GL_ERROR();
+    return AddResource(shaders, program);
+}
+
+bool Graphics::RebuildShader(Shader shader, const char* vSrc, const char* pSrc)
+{
+    ASSERT(shader != 0);
+    GLuint program = GetResource(shaders, shader);
+
+    // Failures are expected while editing, so they are reported and leave the program as it was
+    GLuint stages[2] = { glCreateShader(GL_VERTEX_SHADER), glCreateShader(GL_FRAGMENT_SHADER) };
+    const char* sources[2] = { vSrc, pSrc };
+    bool compiled = true;
+    for (int i = 0; i < 2; ++i)
+    {
+        glShaderSource(stages[i], 1, &sources[i], NULL);
+        glCompileShader(stages[i]);
+        compiled = CheckShaderStatus(stages[i], false) && compiled;
+    }
+
+    GLuint scratch = glCreateProgram();
+    bool linked = false;
+    if (compiled)
+    {
+        glAttachShader(scratch, stages[0]);
+        glAttachShader(scratch, stages[1]);
+        glLinkProgram(scratch);
+        linked = CheckShaderStatus(scratch, true);
+    }
+    glDeleteProgram(scratch);
+
+    if (linked)
+    {
+        GLuint attached[8];
+        GLsizei count = 0;
+        glGetAttachedShaders(program, 8, &count, attached);
+        for (GLsizei i = 0; i < count; ++i)
+            glDetachShader(program, attached[i]);
+
+        glAttachShader(program, stages[0]);
+        glAttachShader(program, stages[1]);
+        if (IsShaderBinarySupported())
+            glProgramParameteriARB(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+    }
+
+    glDeleteShader(stages[0]);
+    glDeleteShader(stages[1]);
+
+    CHECK_GL_ERROR();
+    return linked;
+}
+
+Shader Graphics::CreateShader(unsigned int binaryFormat, const std::vector<unsigned char>& binary)
+{
+    ASSERT(IsShaderBinarySupported());
+
+    GLuint program = glCreateProgram();
+    glProgramBinaryARB(program, binaryFormat, binary.data(), (GLsizei)binary.size());
+
+    // Drivers reject binaries from other versions with a GL error, the caller compiles from source instead.
+    // The rejection is expected, so the error is drained rather than reported
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        return 0;
+    }
+
+    CHECK_GL_ERROR();
+    return AddResource(shaders, program);
+}
+
+bool Graphics::IsShaderBinarySupported()
+{
+    return glGetProgramBinaryARB != nullptr && glProgramBinaryARB != nullptr && glProgramParameteriARB != nullptr;
+}
+
+bool Graphics::GetShaderBinary(Shader shader, unsigned int& binaryFormat, std::vector<unsigned char>& binary)
+{
+    ASSERT(shader != 0);
+    if (!IsShaderBinarySupported())
+        return false;
+
+    GLuint program = GetResource(shaders, shader);
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    GLenum format = 0;
+    binary.resize(length);
+    glGetProgramBinaryARB(program, length, &length, &format, binary.data());
+    binary.resize(length);
+    binaryFormat = format;
+
+    CHECK_GL_ERROR();
+    return length > 0;
+}
+
+std::string Graphics::GetDriverInfo()
+{
+    std::string info;
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (int i = 0; i < 3; ++i)
+    {
+        const GLubyte* str = glGetString(names[i]);
+        info += str != nullptr ? (const char*)str : "";
+        info += '\n';
+    }
+    return info;
 }
 
 void Graphics::DeleteShader(Shader shader)
 {
     ASSERT(shader != 0);
-    glDeleteShader(shader);
+    RemoveResource(shaders, shader);
+}
+
+GLenum AttributeTypeEnum(AttributeType type)
+{
+    switch (type)
+    {
+    case AttributeType::HALF: return GL_HALF_FLOAT;
+    case AttributeType::BYTE: return GL_BYTE;
+    case AttributeType::UNSIGNED_BYTE: return GL_UNSIGNED_BYTE;
+    case AttributeType::SHORT: return GL_SHORT;
+    case AttributeType::UNSIGNED_SHORT: return GL_UNSIGNED_SHORT;
+    case AttributeType::INT_2_10_10_10: return GL_INT_2_10_10_10_REV;
+    default: return GL_FLOAT;
+    }
+}
+
+// Shared with the render thread, a deque keeps handed out layouts in place while new ones are added
+static std::mutex layoutMutex;
+
+static std::deque<std::vector<AttributeFormat>>& Layouts()
+{
+    // Built on first use, vertex types register theirs during static initialization
+    static std::deque<std::vector<AttributeFormat>> layouts;
+    return layouts;
+}
+
+Layout Graphics::CreateLayout(const std::vector<AttributeFormat>& attributeFormat)
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+
+    std::deque<std::vector<AttributeFormat>>& layouts = Layouts();
+    for (size_t i = 0; i < layouts.size(); ++i)
+    {
+        if (layouts[i] == attributeFormat)
+            return (Layout)i + 1;
+    }
 
-    ASSERT(CheckGLError());
+    layouts.push_back(attributeFormat);
+    return (Layout)layouts.size();
 }
 
-void Graphics::BindShader(Shader shader, const std::vector<AttributeFormat>& attributeFormat)
+const std::vector<AttributeFormat>& Graphics::GetLayout(Layout layout)
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+
+    ASSERT(layout > 0 && layout <= Layouts().size());
+    return Layouts()[layout - 1];
+}
+
+void Graphics::BindShader(Shader shader, Layout layout)
 {
     ASSERT(shader != 0);
-    glUseProgram(shader);
+    GLuint program = GetResource(shaders, shader);
+    glUseProgram(program);
 
-    int stride = 0;
-    for (int i = 0; i < attributeFormat.size(); ++i)
-        stride += attributeFormat[i].format;
-    stride *= sizeof(float);
+    const std::vector<AttributeFormat>& attributeFormat = GetLayout(layout);
+
+    int stride = GetVertexSize(attributeFormat);
 
     int offset = 0;
+    unsigned int attributes = 0;
     for (int i = 0; i < attributeFormat.size(); ++i)
     {
-        int loc = glGetAttribLocation(shader, attributeFormat[i].attribute.c_str());
+        const AttributeFormat& attribute = attributeFormat[i];
+        int loc = glGetAttribLocation(program, attribute.attribute.c_str());
         if (loc != -1)
         {
             glEnableVertexAttribArray(loc);
-            glVertexAttribPointer(loc, attributeFormat[i].format, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * offset));
+            glVertexAttribPointer(loc, attribute.format, AttributeTypeEnum(attribute.type), attribute.normalized, stride, (void*)(size_t)offset);
+            attributes |= 1u << loc;
         }
-        offset += attributeFormat[i].format;
+        offset += GetAttributeSize(attribute);
+    }
+
+    // Arrays of a wider format would otherwise keep pointing past the end of a narrower buffer
+    for (int loc = 0; (enabledAttributes & ~attributes) >> loc; ++loc)
+    {
+        if ((enabledAttributes & ~attributes) & (1u << loc))
+            glDisableVertexAttribArray(loc);
     }
+    enabledAttributes = attributes;
+
+    CHECK_GL_ERROR();
+}
+
+int Graphics::GetAttributeSize(const AttributeFormat& attribute)
+{
+    int size = 0;
+    switch (attribute.type)
+    {
+    case AttributeType::FLOAT: size = attribute.format * 4; break;
+    case AttributeType::HALF: size = attribute.format * 2; break;
+    case AttributeType::BYTE: size = attribute.format; break;
+    case AttributeType::UNSIGNED_BYTE: size = attribute.format; break;
+    case AttributeType::SHORT: size = attribute.format * 2; break;
+    case AttributeType::UNSIGNED_SHORT: size = attribute.format * 2; break;
+    case AttributeType::INT_2_10_10_10: size = 4; break;
+    }
+
+    // Every attribute starts on a 4 byte boundary
+    return (size + 3) & ~3;
+}
 
-    ASSERT(CheckGLError());
+int Graphics::GetVertexSize(const std::vector<AttributeFormat>& attributeFormat)
+{
+    int size = 0;
+    for (size_t i = 0; i < attributeFormat.size(); ++i)
+        size += GetAttributeSize(attributeFormat[i]);
+    return size;
 }
 
 void Graphics::DetachShader()
 {
     glUseProgram(0);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, int* i)
 {
     ASSERT(shader != 0);
-    glUniform1iv(glGetUniformLocation(shader, name), count, i);
+    glUniform1iv(glGetUniformLocation(GetResource(shaders, shader), name), count, i);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, float* f)
 {
     ASSERT(shader != 0);
-    glUniform1fv(glGetUniformLocation(shader, name), count, f);
+    glUniform1fv(glGetUniformLocation(GetResource(shaders, shader), name), count, f);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, glm::vec2* v2)
 {
     ASSERT(shader != 0);
-    glUniform2fv(glGetUniformLocation(shader, name), count, glm::value_ptr(v2[0]));
+    glUniform2fv(glGetUniformLocation(GetResource(shaders, shader), name), count, glm::value_ptr(v2[0]));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, glm::vec3* v3)
 {
     ASSERT(shader != 0);
-    glUniform3fv(glGetUniformLocation(shader, name), count, glm::value_ptr(v3[0]));
+    glUniform3fv(glGetUniformLocation(GetResource(shaders, shader), name), count, glm::value_ptr(v3[0]));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, glm::vec4* v4)
 {
     ASSERT(shader != 0);
-    glUniform4fv(glGetUniformLocation(shader, name), count, glm::value_ptr(v4[0]));
+    glUniform4fv(glGetUniformLocation(GetResource(shaders, shader), name), count, glm::value_ptr(v4[0]));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, glm::mat2* m2)
 {
     ASSERT(shader != 0);
-    glUniformMatrix2fv(glGetUniformLocation(shader, name), count, GL_FALSE, glm::value_ptr(m2[0]));
+    glUniformMatrix2fv(glGetUniformLocation(GetResource(shaders, shader), name), count, GL_FALSE, glm::value_ptr(m2[0]));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, glm::mat3* m3)
 {
     ASSERT(shader != 0);
-    glUniformMatrix3fv(glGetUniformLocation(shader, name), count, GL_FALSE, glm::value_ptr(m3[0]));
+    glUniformMatrix3fv(glGetUniformLocation(GetResource(shaders, shader), name), count, GL_FALSE, glm::value_ptr(m3[0]));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::SetUniform(Shader shader, const char* name, int count, glm::mat4* m4)
 {
     ASSERT(shader != 0);
-    glUniformMatrix4fv(glGetUniformLocation(shader, name), count, GL_FALSE, glm::value_ptr(m4[0]));
+    glUniformMatrix4fv(glGetUniformLocation(GetResource(shaders, shader), name), count, GL_FALSE, glm::value_ptr(m4[0]));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::DrawVertices(Primitive primitive, int offset, int count)
@@ -398,104 +897,303 @@ void Graphics::DrawVertices(Primitive primitive, int offset, int count)
     case Primitive::TRIANGLES: glDrawArrays(GL_TRIANGLES, offset, count); break;
     }
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
-void Graphics::DrawIndexed(Primitive primitive, int count)
+void Graphics::DrawIndexed(Primitive primitive, int offset, int count)
 {
+    const void* first = (const void*)(offset * sizeof(unsigned int));
     switch (primitive)
     {
-    case Primitive::POINTS: glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT, 0); break;
-    case Primitive::LINES: glDrawElements(GL_LINES, count, GL_UNSIGNED_INT, 0); break;
-    case Primitive::TRIANGLES: glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0); break;
+    case Primitive::POINTS: glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT, first); break;
+    case Primitive::LINES: glDrawElements(GL_LINES, count, GL_UNSIGNED_INT, first); break;
+    case Primitive::TRIANGLES: glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, first); break;
     }
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
-Texture Graphics::CreateTexture(TextureFormat format, int count, int width, int height, const void* data, bool mipmap)
+void Graphics::DrawIndexedRanges(Primitive primitive, const unsigned int* pOffsets, const int* pCounts, int drawCount)
 {
-    Texture texture;
-    glGenTextures(count, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // GL thread only, so one scratch array serves every call
+    static std::vector<const void*> firsts;
+    firsts.resize(drawCount);
+    for (int i = 0; i < drawCount; ++i)
+        firsts[i] = (const void*)(pOffsets[i] * sizeof(unsigned int));
+
+    switch (primitive)
+    {
+    case Primitive::POINTS: glMultiDrawElements(GL_POINTS, pCounts, GL_UNSIGNED_INT, firsts.data(), drawCount); break;
+    case Primitive::LINES: glMultiDrawElements(GL_LINES, pCounts, GL_UNSIGNED_INT, firsts.data(), drawCount); break;
+    case Primitive::TRIANGLES: glMultiDrawElements(GL_TRIANGLES, pCounts, GL_UNSIGNED_INT, firsts.data(), drawCount); break;
+    }
 
+    CHECK_GL_ERROR();
+}
+
+GLenum CompressedFormat(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TextureFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TextureFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+    }
+}
+
+void TexImage(TextureFormat format, int level, int width, int height, const void* data)
+{
     switch (format)
     {
-    case TextureFormat::RBG24: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data); break;
-    case TextureFormat::RBGA32: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data); break;
+    case TextureFormat::RBG24: glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data); break;
+    case TextureFormat::RBGA32: glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data); break;
+    default: glCompressedTexImage2D(GL_TEXTURE_2D, level, CompressedFormat(format), width, height, 0, Graphics::GetTextureSize(format, width, height), data); break;
     }
+}
+
+bool Graphics::IsTextureFormatSupported(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1:
+    case TextureFormat::BC3: return sf::Context::isExtensionAvailable("GL_EXT_texture_compression_s3tc");
+    case TextureFormat::BC7: return sf::Context::isExtensionAvailable("GL_ARB_texture_compression_bptc");
+    default: return true;
+    }
+}
+
+bool Graphics::IsTextureFormatCompressed(TextureFormat format)
+{
+    return format != TextureFormat::RBG24 && format != TextureFormat::RBGA32;
+}
+
+int Graphics::GetTextureSize(TextureFormat format, int width, int height)
+{
+    // Compressed formats store 4x4 blocks, partial blocks at the edges are padded
+    int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+    switch (format)
+    {
+    case TextureFormat::RBG24: return width * height * 3;
+    case TextureFormat::RBGA32: return width * height * 4;
+    case TextureFormat::BC1: return blocks * 8;
+    default: return blocks * 16;
+    }
+}
+
+Texture Graphics::CreateTexture(int count)
+{
+    // No storage yet, levels are defined one at a time with UpdateTexture
+    ASSERT(count == 1);
+
+    GLuint texture;
+    glGenTextures(count, &texture);
+
+    CHECK_GL_ERROR();
+    return AddResource(textures, texture);
+}
+
+Texture Graphics::CreateTexture(TextureFormat format, int count, int width, int height, const void* data, bool mipmap)
+{
+    // Compressed data cannot be mipmapped by the driver, those chains are uploaded level by level
+    ASSERT(!mipmap || !IsTextureFormatCompressed(format));
+
+    ASSERT(count == 1);
+
+    GLuint texture;
+    glGenTextures(count, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    TexImage(format, 0, width, height, data);
     
     if (mipmap) glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    return texture;
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
+    return AddResource(textures, texture);
 }
 
-void Graphics::DeleteTexture(int count, Texture texture)
+void Graphics::UpdateTexture(Texture texture, TextureFormat format, int level, int width, int height, const void* data)
 {
     ASSERT(texture != 0);
-    glDeleteTextures(count, &texture);
-    texture = 0;
+    glBindTexture(GL_TEXTURE_2D, GetResource(textures, texture));
+    TexImage(format, level, width, height, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
-void Graphics::FilterTexture(Texture texture, TextureWrap s, TextureWrap t, TextureFilter min, TextureFilter mag)
+void Graphics::SetTextureLevels(Texture texture, int baseLevel, int maxLevel)
 {
     ASSERT(texture != 0);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindTexture(GL_TEXTURE_2D, GetResource(textures, texture));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
+    CHECK_GL_ERROR();
+}
+
+void Graphics::ReleaseTextureLevel(Texture texture, int level)
+{
+    // A zero sized level frees its storage, harmless while it sits outside the base and max range
+    ASSERT(texture != 0);
+    glBindTexture(GL_TEXTURE_2D, GetResource(textures, texture));
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    CHECK_GL_ERROR();
+}
+
+void Graphics::GenerateTextureMipmaps(Texture texture)
+{
+    ASSERT(texture != 0);
+    glBindTexture(GL_TEXTURE_2D, GetResource(textures, texture));
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    CHECK_GL_ERROR();
+}
+
+void Graphics::DeleteTexture(int count, Texture texture)
+{
+    ASSERT(count == 1);
+    ASSERT(texture != 0);
+    RemoveResource(textures, texture);
+}
+
+void SetTextureFilter(GLenum target, TextureWrap s, TextureWrap t, TextureFilter min, TextureFilter mag)
+{
     switch (s)
     {
-    case TextureWrap::REPEAT: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); break;
-    case TextureWrap::MIRROR: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT); break;
-    case TextureWrap::EDGE_CLAMP: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); break;
-    case TextureWrap::BORDER_CLAMP: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER); break;
+    case TextureWrap::REPEAT: glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT); break;
+    case TextureWrap::MIRROR: glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT); break;
+    case TextureWrap::EDGE_CLAMP: glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); break;
+    case TextureWrap::BORDER_CLAMP: glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER); break;
     }
 
     switch (t)
     {
-    case TextureWrap::REPEAT: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); break;
-    case TextureWrap::MIRROR: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT); break;
-    case TextureWrap::EDGE_CLAMP: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); break;
-    case TextureWrap::BORDER_CLAMP: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER); break;
+    case TextureWrap::REPEAT: glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT); break;
+    case TextureWrap::MIRROR: glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT); break;
+    case TextureWrap::EDGE_CLAMP: glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); break;
+    case TextureWrap::BORDER_CLAMP: glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER); break;
     }
 
     switch (min)
     {
-    case TextureFilter::NEAREST: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); break;
-    case TextureFilter::LINEAR: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); break;
+    case TextureFilter::NEAREST: glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST); break;
+    case TextureFilter::LINEAR: glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR); break;
 
-    case TextureFilter::NEAREST_NEAREST: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST); break;
-    case TextureFilter::NEAREST_LINEAR: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR); break;
-    case TextureFilter::LINEAR_NEAREST: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST); break;
-    case TextureFilter::LINEAR_LINEAR: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); break;
+    case TextureFilter::NEAREST_NEAREST: glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST); break;
+    case TextureFilter::NEAREST_LINEAR: glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR); break;
+    case TextureFilter::LINEAR_NEAREST: glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST); break;
+    case TextureFilter::LINEAR_LINEAR: glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); break;
     }
 
     switch (mag)
     {
-    case TextureFilter::NEAREST: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); break;
-    case TextureFilter::LINEAR: glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); break;
+    case TextureFilter::NEAREST: glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST); break;
+    case TextureFilter::LINEAR: glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR); break;
     }
+}
 
+void Graphics::FilterTexture(Texture texture, TextureWrap s, TextureWrap t, TextureFilter min, TextureFilter mag)
+{
+    ASSERT(texture != 0);
+    glBindTexture(GL_TEXTURE_2D, GetResource(textures, texture));
+    SetTextureFilter(GL_TEXTURE_2D, s, t, min, mag);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::BindTexture(Texture texture, int loc)
 {
     ASSERT(texture != 0);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindTexture(GL_TEXTURE_2D, GetResource(textures, texture));
     glActiveTexture(GL_TEXTURE0 + loc);
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
 
 void Graphics::DetachTexture()
 {
     glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    CHECK_GL_ERROR();
+}
+
+Texture Graphics::CreateTextureArray(TextureFormat format, int width, int height, int layers, int levels)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+    // Storage for every level up front, layers are filled in afterwards
+    for (int level = 0; level < levels; ++level)
+    {
+        int levelWidth = std::max(width >> level, 1);
+        int levelHeight = std::max(height >> level, 1);
+        switch (format)
+        {
+        case TextureFormat::RBG24: glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB, levelWidth, levelHeight, layers, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr); break;
+        case TextureFormat::RBGA32: glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, levelWidth, levelHeight, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); break;
+        default: glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, CompressedFormat(format), levelWidth, levelHeight, layers, 0, GetTextureSize(format, levelWidth, levelHeight) * layers, nullptr); break;
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    CHECK_GL_ERROR();
+    return AddResource(textures, texture);
+}
+
+void Graphics::UpdateTextureLayer(Texture texture, TextureFormat format, int level, int layer, int width, int height, const void* data)
+{
+    ASSERT(texture != 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, GetResource(textures, texture));
+
+    switch (format)
+    {
+    case TextureFormat::RBG24: glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, data); break;
+    case TextureFormat::RBGA32: glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data); break;
+    default: glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, CompressedFormat(format), GetTextureSize(format, width, height), data); break;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    CHECK_GL_ERROR();
+}
+
+void Graphics::GenerateTextureArrayMipmaps(Texture texture)
+{
+    ASSERT(texture != 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, GetResource(textures, texture));
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    CHECK_GL_ERROR();
+}
+
+void Graphics::FilterTextureArray(Texture texture, TextureWrap s, TextureWrap t, TextureFilter min, TextureFilter mag)
+{
+    ASSERT(texture != 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, GetResource(textures, texture));
+    SetTextureFilter(GL_TEXTURE_2D_ARRAY, s, t, min, mag);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    CHECK_GL_ERROR();
+}
+
+void Graphics::BindTextureArray(Texture texture, int loc)
+{
+    ASSERT(texture != 0);
+    glActiveTexture(GL_TEXTURE0 + loc);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, GetResource(textures, texture));
 
-    ASSERT(CheckGLError());
+    CHECK_GL_ERROR();
 }
\ No newline at end of file
@@ -5,9 +5,11 @@
 #include <string>
 #include <vector>
 
+// Generational handles, not GL names, a stale one is caught instead of aliasing a reused slot
 using Buffer = unsigned int;
 using Shader = unsigned int;
 using Texture = unsigned int;
+using Layout = unsigned int;
 
 enum struct Primitive { POINTS, LINES, TRIANGLES };
 
@@ -17,26 +19,53 @@ enum struct BlendFunc { ADD, MULTIPLY, INTERPOLATE };
 
 enum struct DepthFunc { NEVER, LESS, EQUAL, LEQUAL, GREATER, NOTEQUAL, GEQUAL, ALWAYS };
 
-enum struct TextureFormat { RBG24, RBGA32 };
+// BC1 is opaque RGB, BC3 and BC7 carry alpha, BC5 holds two channels for normal maps
+enum struct TextureFormat { RBG24, RBGA32, BC1, BC3, BC5, BC7 };
 
 enum struct TextureWrap { REPEAT, MIRROR, EDGE_CLAMP, BORDER_CLAMP };
 
 enum struct TextureFilter { REPEAT, NEAREST, LINEAR, NEAREST_NEAREST, NEAREST_LINEAR, LINEAR_NEAREST, LINEAR_LINEAR };
 
+// NONE skips all checks, DEBUG_OUTPUT reports through the KHR_debug callback, SYNCHRONOUS polls glGetError after every call
+enum struct ErrorCheck { NONE, DEBUG_OUTPUT, SYNCHRONOUS };
+
+enum struct DebugSeverity { NOTIFICATION, LOW, MEDIUM, HIGH };
+
+enum struct DebugSource { API, WINDOW_SYSTEM, SHADER_COMPILER, THIRD_PARTY, APPLICATION, OTHER };
+
+// INT_2_10_10_10 packs four components into 32 bits, x in the lowest bits
+enum struct AttributeType { FLOAT, HALF, BYTE, UNSIGNED_BYTE, SHORT, UNSIGNED_SHORT, INT_2_10_10_10 };
+
 struct AttributeFormat
 {
-	AttributeFormat(const std::string& attribute, int format)
-		: attribute(attribute), format(format)
+	AttributeFormat(const std::string& attribute, int format, AttributeType type = AttributeType::FLOAT, bool normalized = false)
+		: attribute(attribute), format(format), type(type), normalized(normalized)
 	{}
 
+	bool operator==(const AttributeFormat& other) const
+	{
+		return attribute == other.attribute && format == other.format && type == other.type && normalized == other.normalized;
+	}
+
 	std::string attribute;
 	int format = 0;
+	AttributeType type = AttributeType::FLOAT;
+	bool normalized = false;
 };
 
 class Graphics
 {
 public:
 	static void Initialize();
+	// Deletes resources released during the frame, once nothing recorded can still refer to them
+	static void EndFrame();
+	// Flushes pending deletions and reports handles that were never released
+	static void Shutdown();
+
+	static bool SetErrorCheck(ErrorCheck mode);
+	static ErrorCheck GetErrorCheck();
+	static void SetDebugSeverity(DebugSeverity minimum);
+	static void SetDebugSource(DebugSource source, bool enable);
 
 	static void SetViewport(float x, float y, float width, float height);
 	static void SetClearColor(float r, float g, float b, float a);
@@ -52,6 +81,7 @@ public:
 	static void SetDepthTest(bool enable);
 	static void SetDepthWrite(bool enable);
 	static void SetDepthFunc(DepthFunc func);
+	static void SetColorWrite(bool enable);
 	static void SetSmoothing(bool enable);
 	
 	static Buffer CreateBuffer(int bufferCount, int dataCount, const void* data, bool index, bool dynamic);
@@ -61,8 +91,21 @@ public:
 	static void DetachBuffer();
 
 	static Shader CreateShader(const char* vSrc, const char* pSrc, const char* gSrc);
+	static Shader CreateShader(unsigned int binaryFormat, const std::vector<unsigned char>& binary);
+	// Relinks an existing program from new sources, false leaves it untouched
+	static bool RebuildShader(Shader shader, const char* vSrc, const char* pSrc);
+	static bool IsShaderBinarySupported();
+	static bool GetShaderBinary(Shader shader, unsigned int& binaryFormat, std::vector<unsigned char>& binary);
+	// Identifies the driver that produced a binary, they are not portable between drivers
+	static std::string GetDriverInfo();
 	static void DeleteShader(Shader shader);
-	static void BindShader(Shader shader, const std::vector<AttributeFormat>& attributeFormat);
+	static void BindShader(Shader shader, Layout layout);
+	static int GetAttributeSize(const AttributeFormat& attribute);
+	static int GetVertexSize(const std::vector<AttributeFormat>& attributeFormat);
+
+	// Any thread, equal formats share one handle and stay registered for the whole run
+	static Layout CreateLayout(const std::vector<AttributeFormat>& attributeFormat);
+	static const std::vector<AttributeFormat>& GetLayout(Layout layout);
 	static void DetachShader();
 	static void SetUniform(Shader shader, const char* name, int count, int* i);
 	static void SetUniform(Shader shader, const char* name, int count, float* f);
@@ -74,11 +117,29 @@ public:
 	static void SetUniform(Shader shader, const char* name, int count, glm::mat4* m4);
 
 	static void DrawVertices(Primitive primitive, int offset, int count);
-	static void DrawIndexed(Primitive primitive, int count);
+	static void DrawIndexed(Primitive primitive, int offset, int count);
+	// One call for several ranges of the bound index buffer, offsets are in indices
+	static void DrawIndexedRanges(Primitive primitive, const unsigned int* pOffsets, const int* pCounts, int drawCount);
 
+	static bool IsTextureFormatSupported(TextureFormat format);
+	static bool IsTextureFormatCompressed(TextureFormat format);
+	static int GetTextureSize(TextureFormat format, int width, int height);
+
+	static Texture CreateTexture(int count);
 	static Texture CreateTexture(TextureFormat format, int count, int width, int height, const void* data, bool mipmap);
+	static void UpdateTexture(Texture texture, TextureFormat format, int level, int width, int height, const void* data);
+	static void SetTextureLevels(Texture texture, int baseLevel, int maxLevel);
+	static void ReleaseTextureLevel(Texture texture, int level);
+	static void GenerateTextureMipmaps(Texture texture);
 	static void DeleteTexture(int count, Texture texture);
 	static void FilterTexture(Texture texture, TextureWrap s, TextureWrap t, TextureFilter min, TextureFilter mag);
 	static void BindTexture(Texture texture, int loc);
 	static void DetachTexture();
+
+	// Same sized textures packed as layers so materials can share one binding
+	static Texture CreateTextureArray(TextureFormat format, int width, int height, int layers, int levels);
+	static void UpdateTextureLayer(Texture texture, TextureFormat format, int level, int layer, int width, int height, const void* data);
+	static void GenerateTextureArrayMipmaps(Texture texture);
+	static void FilterTextureArray(Texture texture, TextureWrap s, TextureWrap t, TextureFilter min, TextureFilter mag);
+	static void BindTextureArray(Texture texture, int loc);
 };
\ No newline at end of file
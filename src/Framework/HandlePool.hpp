@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+// Generational handles over a dense array, laid out like the GPU handles: slot + 1 in the low bits and the
+// number of times the slot was reused above, so 0 is never handed out and a stale handle finds nothing.
+// Any thread, values are copied out under the lock so keep them cheap to copy, a shared_ptr for big data
+template <typename T>
+class HandlePool
+{
+public:
+	static const unsigned int slotBits = 20;
+	static const unsigned int slotMask = (1u << slotBits) - 1;
+	static const unsigned int generationMask = (1u << (32 - slotBits)) - 1;
+
+	unsigned int Add(const T& value)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned int slot;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+			values[slot] = value;
+		}
+		else
+		{
+			slot = (unsigned int)values.size();
+			assert(slot < slotMask);
+			values.push_back(value);
+			generations.push_back(0);
+		}
+		return (generations[slot] << slotBits) | (slot + 1);
+	}
+
+	// Stale handles are ignored, so removing twice is harmless
+	void Remove(unsigned int handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!IsLive(handle))
+			return;
+
+		unsigned int slot = (handle & slotMask) - 1;
+		values[slot] = T();
+		generations[slot] = (generations[slot] + 1) & generationMask;
+		freeSlots.push_back(slot);
+	}
+
+	// A default value for stale handles
+	T Get(unsigned int handle) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return IsLive(handle) ? values[(handle & slotMask) - 1] : T();
+	}
+
+private:
+	bool IsLive(unsigned int handle) const
+	{
+		unsigned int slot = (handle & slotMask) - 1;
+		return handle != 0 && slot < values.size() && generations[slot] == handle >> slotBits;
+	}
+
+	mutable std::mutex mutex;
+	std::vector<T> values;
+	std::vector<unsigned int> generations;
+	std::vector<unsigned int> freeSlots;
+};
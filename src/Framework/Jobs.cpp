@@ -0,0 +1,238 @@
+#include "Jobs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#define ASSERT(expr) assert(expr)
+
+// Queue 0 is shared by every thread that is not a worker, workers own queues 1..n
+static thread_local int workerIndex = 0;
+
+long long NowMicroseconds()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+JobSystem::~JobSystem()
+{
+    if (running)
+        Stop();
+}
+
+void JobSystem::Start(int workerCount)
+{
+    ASSERT(!running);
+
+    if (workerCount < 0)
+        workerCount = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+
+    queues.resize(workerCount + 1);
+    for (size_t i = 0; i < queues.size(); ++i)
+        queues[i] = new Queue();
+
+    running = true;
+    for (int i = 0; i < workerCount; ++i)
+        workers.emplace_back(&JobSystem::WorkerMain, this, i + 1);
+}
+
+void JobSystem::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    sleepCondition.notify_all();
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+
+    for (size_t i = 0; i < queues.size(); ++i)
+        delete queues[i];
+    queues.clear();
+}
+
+int JobSystem::GetWorkerCount() const
+{
+    return (int)workers.size();
+}
+
+void JobSystem::SetProfileHook(const JobProfileHook& hook)
+{
+    profileHook = hook;
+}
+
+void JobSystem::Run(const char* name, const JobFunction& function, JobCounter* pCounter, JobCounter* pDependency)
+{
+    Job job;
+    job.function = function;
+    job.name = name;
+    job.pCounter = pCounter;
+
+    if (pCounter != nullptr)
+        pCounter->count++;
+
+    // Without workers everything runs inline on the calling thread
+    if (queues.empty())
+    {
+        if (pDependency != nullptr)
+            Wait(*pDependency);
+        Execute(job);
+        return;
+    }
+
+    if (pDependency != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(pDependency->mutex);
+        if (pDependency->count.load() != 0)
+        {
+            pDependency->continuations.push_back(job);
+            return;
+        }
+    }
+
+    Push(job);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    // Help out instead of blocking so waiting on a worker cannot deadlock the pool
+    while (!counter.IsDone())
+    {
+        if (!TryRunOne())
+            std::this_thread::yield();
+    }
+
+    // The last job still holds the lock while it collects continuations, wait for it to let go
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::ParallelFor(const char* name, size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& function)
+{
+    if (count == 0)
+        return;
+
+    grain = std::max<size_t>(grain, 1);
+
+    JobCounter counter;
+    size_t begin = 0;
+    for (; begin + grain < count; begin += grain)
+    {
+        size_t end = begin + grain;
+        Run(name, [&function, begin, end]() { function(begin, end); }, &counter);
+    }
+
+    // The calling thread takes the last range itself
+    Job last;
+    last.function = [&function, begin, count]() { function(begin, count); };
+    last.name = name;
+    Execute(last);
+
+    Wait(counter);
+}
+
+void JobSystem::WorkerMain(int index)
+{
+    workerIndex = index;
+
+    while (true)
+    {
+        if (TryRunOne())
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this] { return queued.load() > 0 || !running; });
+        if (!running)
+            break;
+    }
+}
+
+void JobSystem::Push(const Job& job)
+{
+    Queue& queue = *queues[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    sleepCondition.notify_one();
+}
+
+bool JobSystem::Pop(Job& job)
+{
+    // Own queue from the back for locality, then steal the oldest job from the others
+    {
+        Queue& queue = *queues[workerIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue& queue = *queues[(workerIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool JobSystem::TryRunOne()
+{
+    if (queues.empty())
+        return false;
+
+    Job job;
+    if (!Pop(job))
+        return false;
+
+    Execute(job);
+    return true;
+}
+
+void JobSystem::Execute(Job& job)
+{
+    if (profileHook)
+    {
+        long long start = NowMicroseconds();
+        job.function();
+        profileHook(job.name, workerIndex, start, NowMicroseconds());
+    }
+    else
+    {
+        job.function();
+    }
+
+    JobCounter* pCounter = job.pCounter;
+    if (pCounter == nullptr)
+        return;
+
+    // The counter may be destroyed by its waiter as soon as the lock is released
+    std::vector<Job> continuations;
+    {
+        std::lock_guard<std::mutex> lock(pCounter->mutex);
+        if (--pCounter->count == 0)
+            continuations.swap(pCounter->continuations);
+    }
+
+    for (size_t i = 0; i < continuations.size(); ++i)
+        Push(continuations[i]);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using JobFunction = std::function<void()>;
+
+// Receives the job name, the worker that ran it and its start and end time in microseconds
+using JobProfileHook = std::function<void(const char* name, int worker, long long start, long long end)>;
+
+class JobCounter;
+
+struct Job
+{
+	JobFunction function;
+	const char* name = nullptr;
+	JobCounter* pCounter = nullptr;
+};
+
+// Counts outstanding jobs, jobs may also be queued to run once it reaches zero
+class JobCounter
+{
+public:
+	bool IsDone() const { return count.load() == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> count{ 0 };
+	std::mutex mutex;
+	std::vector<Job> continuations;
+};
+
+class JobSystem
+{
+public:
+	// Joins the workers if Stop was never reached
+	~JobSystem();
+
+	// A worker count below zero uses one worker per hardware thread besides the calling one
+	void Start(int workerCount = -1);
+	void Stop();
+
+	int GetWorkerCount() const;
+	void SetProfileHook(const JobProfileHook& hook);
+
+	void Run(const char* name, const JobFunction& function, JobCounter* pCounter = nullptr, JobCounter* pDependency = nullptr);
+	void Wait(JobCounter& counter);
+
+	void ParallelFor(const char* name, size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& function);
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	void WorkerMain(int index);
+	void Push(const Job& job);
+	bool Pop(Job& job);
+	bool TryRunOne();
+	void Execute(Job& job);
+
+	std::vector<std::thread> workers;
+	std::vector<Queue*> queues;
+
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	std::atomic<int> queued{ 0 };
+	std::atomic<bool> running{ false };
+
+	JobProfileHook profileHook;
+};
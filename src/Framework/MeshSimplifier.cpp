@@ -0,0 +1,267 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#define ASSERT(expr) assert(expr)
+
+// Symmetric 4x4 matrix summing squared distances to planes, only the upper triangle is stored
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        return *this;
+    }
+};
+
+static void AddPlane(Quadric& q, const glm::dvec3& n, double d)
+{
+    q.a00 += n.x * n.x; q.a01 += n.x * n.y; q.a02 += n.x * n.z; q.a03 += n.x * d;
+    q.a11 += n.y * n.y; q.a12 += n.y * n.z; q.a13 += n.y * d;
+    q.a22 += n.z * n.z; q.a23 += n.z * d;
+    q.a33 += d * d;
+}
+
+static double Evaluate(const Quadric& q, const glm::vec3& p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double e = q.a00 * x * x + 2 * q.a01 * x * y + 2 * q.a02 * x * z + 2 * q.a03 * x
+             + q.a11 * y * y + 2 * q.a12 * y * z + 2 * q.a13 * y
+             + q.a22 * z * z + 2 * q.a23 * z
+             + q.a33;
+    return std::max(e, 0.0);
+}
+
+struct Collapse
+{
+    unsigned int from;
+    unsigned int to;
+    double cost;
+};
+
+// First vertex at each distinct position, attribute seams show up as positions shared by several vertices
+static void GroupPositions(const glm::vec3* pPositions, size_t vertexCount, std::vector<unsigned int>& groups)
+{
+    std::vector<unsigned int> order(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        order[i] = (unsigned int)i;
+
+    auto less = [pPositions](unsigned int a, unsigned int b)
+    {
+        const glm::vec3& pa = pPositions[a];
+        const glm::vec3& pb = pPositions[b];
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    groups.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        bool same = i > 0 && pPositions[order[i]] == pPositions[order[i - 1]];
+        groups[order[i]] = same ? groups[order[i - 1]] : order[i];
+    }
+}
+
+float MeshSimplifier::Simplify(const glm::vec3* pPositions, size_t vertexCount, const unsigned int* pIndices, size_t indexCount, size_t targetCount, std::vector<unsigned int>& out)
+{
+    ASSERT(indexCount % 3 == 0);
+    out.assign(pIndices, pIndices + indexCount);
+
+    std::vector<unsigned int> groups;
+    GroupPositions(pPositions, vertexCount, groups);
+
+    // Seams are locked, moving one side would tear the texture mapping apart
+    std::vector<unsigned int> groupSizes(vertexCount, 0);
+    for (size_t i = 0; i < vertexCount; ++i)
+        groupSizes[groups[i]]++;
+
+    std::vector<bool> locked(vertexCount, false);
+    for (size_t i = 0; i < vertexCount; ++i)
+        locked[i] = groupSizes[groups[i]] > 1;
+
+    // So are the ends of edges with one triangle or more than two, they would open holes or shrink outlines
+    std::vector<uint64_t> edges;
+    edges.reserve(indexCount);
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            uint64_t a = groups[out[i + e]];
+            uint64_t b = groups[out[i + (e + 1) % 3]];
+            edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<bool> lockedGroups(vertexCount, false);
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            j++;
+        if (j - i != 2)
+        {
+            lockedGroups[edges[i] >> 32] = true;
+            lockedGroups[edges[i] & 0xFFFFFFFF] = true;
+        }
+        i = j;
+    }
+    std::vector<uint64_t>().swap(edges);
+
+    for (size_t i = 0; i < vertexCount; ++i)
+        locked[i] = locked[i] || lockedGroups[groups[i]];
+
+    // Unweighted planes, so the cost reads as a sum of squared distances
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        glm::dvec3 p0 = glm::dvec3(pPositions[out[i]]);
+        glm::dvec3 n = glm::cross(glm::dvec3(pPositions[out[i + 1]]) - p0, glm::dvec3(pPositions[out[i + 2]]) - p0);
+        double length = glm::length(n);
+        if (length <= 0.0)
+            continue;
+
+        n /= length;
+        Quadric q;
+        AddPlane(q, n, -glm::dot(n, p0));
+        for (int c = 0; c < 3; ++c)
+            quadrics[groups[out[i + c]]] += q;
+    }
+
+    double maxCost = 0.0;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+
+    // Each pass collapses the cheapest edges whose neighbourhoods do not overlap, then rebuilds
+    while (out.size() > targetCount)
+    {
+        size_t triangleCount = out.size() / 3;
+
+        // Triangles around each vertex, packed by vertex
+        offsets.assign(vertexCount + 1, 0);
+        for (size_t i = 0; i < out.size(); ++i)
+            offsets[out[i] + 1]++;
+        for (size_t i = 0; i < vertexCount; ++i)
+            offsets[i + 1] += offsets[i];
+        triangles.resize(out.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < out.size(); ++i)
+            triangles[fill[out[i]]++] = (unsigned int)(i / 3);
+
+        collapses.clear();
+        for (size_t i = 0; i < out.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                unsigned int a = out[i + e];
+                unsigned int b = out[i + (e + 1) % 3];
+                for (int direction = 0; direction < 2; ++direction, std::swap(a, b))
+                {
+                    if (locked[a])
+                        continue;
+
+                    Quadric q = quadrics[groups[a]];
+                    q += quadrics[groups[b]];
+                    collapses.push_back(Collapse{ a, b, Evaluate(q, pPositions[b]) });
+                }
+            }
+        }
+
+        if (collapses.empty())
+            break;
+
+        // A pass rarely gets through more than a few candidates per triangle it removes, so only those are sorted
+        size_t wanted = triangleCount - targetCount / 3;
+        size_t considered = std::min(collapses.size(), std::max(wanted * 8, (size_t)1024));
+        auto cheaper = [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; };
+        std::nth_element(collapses.begin(), collapses.begin() + considered - 1, collapses.end(), cheaper);
+        std::sort(collapses.begin(), collapses.begin() + considered, cheaper);
+
+        for (size_t i = 0; i < vertexCount; ++i)
+            remap[i] = (unsigned int)i;
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t removed = 0;
+        for (size_t c = 0; c < considered && removed < wanted; ++c)
+        {
+            const Collapse& collapse = collapses[c];
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Moving the vertex must not fold any of its other triangles over
+            bool valid = true;
+            size_t shared = 0;
+            for (unsigned int t = offsets[collapse.from]; t < offsets[collapse.from + 1] && valid; ++t)
+            {
+                const unsigned int* pTriangle = &out[triangles[t] * 3];
+                if (pTriangle[0] == collapse.to || pTriangle[1] == collapse.to || pTriangle[2] == collapse.to)
+                {
+                    shared++;
+                    continue;
+                }
+
+                glm::vec3 p[3] = { pPositions[pTriangle[0]], pPositions[pTriangle[1]], pPositions[pTriangle[2]] };
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (int k = 0; k < 3; ++k)
+                {
+                    if (pTriangle[k] == collapse.from)
+                        p[k] = pPositions[collapse.to];
+                }
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                valid = glm::dot(before, before) == 0.0f || glm::dot(before, after) > 0.0f;
+            }
+
+            if (!valid || shared == 0)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[groups[collapse.to]] += quadrics[groups[collapse.from]];
+            maxCost = std::max(maxCost, collapse.cost);
+            removed += shared;
+
+            // Later collapses this pass stay clear of the triangles that just changed
+            for (unsigned int t = offsets[collapse.from]; t < offsets[collapse.from + 1]; ++t)
+            {
+                const unsigned int* pTriangle = &out[triangles[t] * 3];
+                touched[pTriangle[0]] = touched[pTriangle[1]] = touched[pTriangle[2]] = true;
+            }
+        }
+
+        if (removed == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < out.size(); i += 3)
+        {
+            unsigned int a = remap[out[i]];
+            unsigned int b = remap[out[i + 1]];
+            unsigned int c = remap[out[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+
+            out[write++] = a;
+            out[write++] = b;
+            out[write++] = c;
+        }
+        out.resize(write);
+    }
+
+    return (float)std::sqrt(maxCost);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Quadric error edge collapse over indexed triangle lists. Vertices only ever move onto a neighbour, so
+// every level indexes the same vertex buffer. Attribute seams and open borders are kept in place
+class MeshSimplifier
+{
+public:
+	// Collapses edges until at most targetCount indices are left or nothing else can go. Returns how far
+	// the surface moved, in the units of the positions
+	static float Simplify(const glm::vec3* pPositions, size_t vertexCount, const unsigned int* pIndices, size_t indexCount, size_t targetCount, std::vector<unsigned int>& out);
+};
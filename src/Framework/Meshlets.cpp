@@ -0,0 +1,174 @@
+#include "Meshlets.hpp"
+#include "HandlePool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#define ASSERT(expr) assert(expr)
+
+// Imports create sets on the GL thread while the main thread spawns them
+static HandlePool<std::shared_ptr<const std::vector<Meshlet>>> meshletSets;
+
+static void ComputeMeshletBounds(const glm::vec3* pPositions, const unsigned int* pIndices, Meshlet& meshlet)
+{
+    glm::vec3 min = pPositions[pIndices[meshlet.offset]];
+    glm::vec3 max = min;
+    for (unsigned int i = meshlet.offset; i < meshlet.offset + meshlet.count; ++i)
+    {
+        min = glm::min(min, pPositions[pIndices[i]]);
+        max = glm::max(max, pPositions[pIndices[i]]);
+    }
+
+    meshlet.center = (min + max) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (unsigned int i = meshlet.offset; i < meshlet.offset + meshlet.count; ++i)
+        meshlet.radius = std::max(meshlet.radius, glm::length(pPositions[pIndices[i]] - meshlet.center));
+
+    // The axis averages the normals, the cone opens as wide as the one furthest from it
+    glm::vec3 sum = glm::vec3(0);
+    for (unsigned int i = meshlet.offset; i < meshlet.offset + meshlet.count; i += 3)
+    {
+        const glm::vec3& p0 = pPositions[pIndices[i]];
+        glm::vec3 normal = glm::cross(pPositions[pIndices[i + 1]] - p0, pPositions[pIndices[i + 2]] - p0);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            sum += normal / length;
+    }
+
+    meshlet.coneAxis = glm::vec3(0, 0, 1);
+    meshlet.coneCutoff = 1.0f;
+    float sumLength = glm::length(sum);
+    if (sumLength <= 0.0f)
+        return;
+
+    glm::vec3 axis = sum / sumLength;
+    float minDot = 1.0f;
+    for (unsigned int i = meshlet.offset; i < meshlet.offset + meshlet.count; i += 3)
+    {
+        const glm::vec3& p0 = pPositions[pIndices[i]];
+        glm::vec3 normal = glm::cross(pPositions[pIndices[i + 1]] - p0, pPositions[pIndices[i + 2]] - p0);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            minDot = std::min(minDot, glm::dot(normal / length, axis));
+    }
+
+    // Normals spread over a hemisphere or more leave no direction that only sees backs
+    meshlet.coneAxis = axis;
+    if (minDot > 0.0f)
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void Meshlets::Build(const glm::vec3* pPositions, size_t vertexCount, unsigned int* pIndices, size_t indexCount, std::vector<Meshlet>& meshlets)
+{
+    ASSERT(indexCount % 3 == 0);
+    size_t triangleCount = indexCount / 3;
+    meshlets.clear();
+
+    // Triangles around each vertex, packed by vertex
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i)
+        offsets[pIndices[i] + 1]++;
+    for (size_t i = 0; i < vertexCount; ++i)
+        offsets[i + 1] += offsets[i];
+    std::vector<unsigned int> adjacency(indexCount);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+        adjacency[fill[pIndices[i]]++] = (unsigned int)(i / 3);
+
+    // Vertices remember the last meshlet they joined, so membership needs no clearing between meshlets
+    std::vector<unsigned int> owner(vertexCount, ~0u);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> order;
+    std::vector<unsigned int> vertices;
+    order.reserve(triangleCount);
+    vertices.reserve(maxVertices);
+
+    size_t seed = 0;
+    while (order.size() < triangleCount)
+    {
+        while (emitted[seed])
+            seed++;
+
+        unsigned int id = (unsigned int)meshlets.size();
+        size_t first = order.size();
+        vertices.clear();
+
+        size_t triangle = seed;
+        for (;;)
+        {
+            emitted[triangle] = true;
+            order.push_back((unsigned int)triangle);
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int vertex = pIndices[triangle * 3 + c];
+                if (owner[vertex] != id)
+                {
+                    owner[vertex] = id;
+                    vertices.push_back(vertex);
+                }
+            }
+
+            if (order.size() - first == maxTriangles)
+                break;
+
+            // The neighbour adding the fewest vertices, one closing a fan adds none
+            size_t best = triangleCount;
+            int bestAdded = 3;
+            for (size_t i = 0; i < vertices.size() && bestAdded > 0; ++i)
+            {
+                for (unsigned int t = offsets[vertices[i]]; t < offsets[vertices[i] + 1]; ++t)
+                {
+                    unsigned int candidate = adjacency[t];
+                    if (emitted[candidate])
+                        continue;
+
+                    const unsigned int* pTriangle = &pIndices[candidate * 3];
+                    int added = (owner[pTriangle[0]] != id) + (owner[pTriangle[1]] != id) + (owner[pTriangle[2]] != id);
+                    if (added < bestAdded && vertices.size() + added <= maxVertices)
+                    {
+                        best = candidate;
+                        bestAdded = added;
+                        if (added == 0)
+                            break;
+                    }
+                }
+            }
+
+            if (best == triangleCount)
+                break;
+            triangle = best;
+        }
+
+        Meshlet meshlet;
+        meshlet.offset = (unsigned int)(first * 3);
+        meshlet.count = (unsigned int)((order.size() - first) * 3);
+        meshlets.push_back(meshlet);
+    }
+
+    std::vector<unsigned int> source(pIndices, pIndices + indexCount);
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        pIndices[i * 3] = source[order[i] * 3];
+        pIndices[i * 3 + 1] = source[order[i] * 3 + 1];
+        pIndices[i * 3 + 2] = source[order[i] * 3 + 2];
+    }
+
+    for (size_t i = 0; i < meshlets.size(); ++i)
+        ComputeMeshletBounds(pPositions, pIndices, meshlets[i]);
+}
+
+MeshletSet Meshlets::Create(const std::vector<Meshlet>& meshlets)
+{
+    return meshletSets.Add(std::make_shared<const std::vector<Meshlet>>(meshlets));
+}
+
+void Meshlets::Delete(MeshletSet set)
+{
+    meshletSets.Remove(set);
+}
+
+std::shared_ptr<const std::vector<Meshlet>> Meshlets::Get(MeshletSet set)
+{
+    return meshletSets.Get(set);
+}
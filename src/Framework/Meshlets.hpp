@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Generational handle to the meshlets of one mesh, 0 is a mesh drawn whole
+using MeshletSet = unsigned int;
+
+// A run of triangles small enough to cull on its own. The range is relative to the mesh's first index,
+// the cone bounds the triangle normals so a cluster facing away can be dropped without looking at them
+struct Meshlet
+{
+	unsigned int offset = 0;
+	unsigned int count = 0;
+
+	glm::vec3 center = glm::vec3(0);
+	float radius = 0.0f;
+
+	glm::vec3 coneAxis = glm::vec3(0, 0, 1);
+	// Sine of the normals' spread, 1 never culls
+	float coneCutoff = 1.0f;
+};
+
+class Meshlets
+{
+public:
+	static const size_t maxVertices = 64;
+	static const size_t maxTriangles = 124;
+
+	// Reorders the triangles in place so every meshlet is a contiguous range, neighbours are grown
+	// into the same meshlet first so the bounds stay tight
+	static void Build(const glm::vec3* pPositions, size_t vertexCount, unsigned int* pIndices, size_t indexCount, std::vector<Meshlet>& meshlets);
+
+	// Any thread. A snapshot stays valid after the set is deleted, so frames in flight keep theirs
+	static MeshletSet Create(const std::vector<Meshlet>& meshlets);
+	static void Delete(MeshletSet set);
+	static std::shared_ptr<const std::vector<Meshlet>> Get(MeshletSet set);
+
+	// Whether the camera, given in the meshlet's space, can only see the back of every triangle
+	static bool IsBackFacing(const Meshlet& meshlet, const glm::vec3& camera)
+	{
+		glm::vec3 toCenter = meshlet.center - camera;
+		return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+	}
+};
@@ -0,0 +1,307 @@
+#include "OcclusionBuffer.hpp"
+#include "HandlePool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+#define ASSERT(expr) assert(expr)
+
+struct OccluderMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+};
+
+// Imports create occluders on the GL thread while the main thread rasterizes them, a mesh deleted
+// meanwhile lives until the rasterizer lets go of it
+static HandlePool<std::shared_ptr<const OccluderMesh>> occluders;
+
+Occluder OcclusionBuffer::CreateOccluder(const glm::vec3* pPositions, size_t vertexCount, const unsigned int* pIndices, size_t indexCount)
+{
+    ASSERT(indexCount % 3 == 0);
+
+    // Only the vertices the triangles use are kept, a range of a shared buffer may touch few of them
+    std::shared_ptr<OccluderMesh> pMesh = std::make_shared<OccluderMesh>();
+    OccluderMesh& mesh = *pMesh;
+    std::vector<unsigned int> remap(vertexCount, 0);
+    mesh.indices.reserve(indexCount);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        unsigned int index = pIndices[i];
+        ASSERT(index < vertexCount);
+        if (remap[index] == 0)
+        {
+            mesh.positions.push_back(pPositions[index]);
+            remap[index] = (unsigned int)mesh.positions.size();
+        }
+        mesh.indices.push_back(remap[index] - 1);
+    }
+
+    return occluders.Add(pMesh);
+}
+
+void OcclusionBuffer::DeleteOccluder(Occluder occluder)
+{
+    occluders.Remove(occluder);
+}
+
+void OcclusionBuffer::Begin(int width, int height)
+{
+    ASSERT(width > 0 && height > 0);
+    this->width = (width + 3) & ~3;
+    this->height = height;
+    rasterized = 0;
+
+    levels.clear();
+    depths.assign((size_t)this->width * height, 1.0f);
+}
+
+void OcclusionBuffer::Rasterize(Occluder occluder, const glm::mat4& mvp)
+{
+    std::shared_ptr<const OccluderMesh> pMesh = occluders.Get(occluder);
+    if (!pMesh)
+        return;
+
+    clipped.resize(pMesh->positions.size());
+    for (size_t i = 0; i < pMesh->positions.size(); ++i)
+        clipped[i] = mvp * glm::vec4(pMesh->positions[i], 1.0f);
+
+    for (size_t i = 0; i < pMesh->indices.size(); i += 3)
+    {
+        glm::vec4 v[4] = { clipped[pMesh->indices[i]], clipped[pMesh->indices[i + 1]], clipped[pMesh->indices[i + 2]] };
+
+        // Triangles wholly outside one side of the frustum are dropped before any divide
+        bool outside = false;
+        for (int axis = 0; axis < 3 && !outside; ++axis)
+        {
+            outside = (v[0][axis] > v[0].w && v[1][axis] > v[1].w && v[2][axis] > v[2].w)
+                   || (v[0][axis] < -v[0].w && v[1][axis] < -v[1].w && v[2][axis] < -v[2].w);
+        }
+        if (outside)
+            continue;
+
+        // Clip against the near plane, keeping one corner in front gives a triangle and two give a quad
+        bool front[3] = { v[0].z >= -v[0].w, v[1].z >= -v[1].w, v[2].z >= -v[2].w };
+        if (front[0] && front[1] && front[2])
+        {
+            RasterizeTriangle(v[0], v[1], v[2]);
+            continue;
+        }
+
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int j = 0; j < 3; ++j)
+        {
+            const glm::vec4& p = v[j];
+            const glm::vec4& q = v[(j + 1) % 3];
+            if (front[j])
+                polygon[count++] = p;
+            if (front[j] != front[(j + 1) % 3])
+            {
+                float dp = p.z + p.w;
+                float dq = q.z + q.w;
+                polygon[count++] = p + (q - p) * (dp / (dp - dq));
+            }
+        }
+
+        for (int j = 2; j < count; ++j)
+            RasterizeTriangle(polygon[0], polygon[j - 1], polygon[j]);
+    }
+    rasterized++;
+}
+
+void OcclusionBuffer::RasterizeTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+    // Pixel space with y up like NDC, depth mapped to [0, 1]
+    glm::vec3 p[3];
+    const glm::vec4* v[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; ++i)
+    {
+        float invW = 1.0f / v[i]->w;
+        p[i] = glm::vec3((v[i]->x * invW * 0.5f + 0.5f) * width, (v[i]->y * invW * 0.5f + 0.5f) * height, v[i]->z * invW * 0.5f + 0.5f);
+    }
+
+    // Both windings occlude, a clockwise triangle is turned around so inside is always positive
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    if (std::fabs(area) < 1e-6f)
+        return;
+    if (area < 0.0f)
+    {
+        std::swap(p[1], p[2]);
+        area = -area;
+    }
+
+    int minX = std::max((int)std::floor(std::min(p[0].x, std::min(p[1].x, p[2].x))), 0) & ~3;
+    int maxX = std::min((int)std::ceil(std::max(p[0].x, std::max(p[1].x, p[2].x))), width - 1);
+    int minY = std::max((int)std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y))), 0);
+    int maxY = std::min((int)std::ceil(std::max(p[0].y, std::max(p[1].y, p[2].y))), height - 1);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // Edge i is opposite corner i, its value over the area is that corner's weight, so depth is a plane too
+    float edgeX[3], edgeY[3], edgeC[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const glm::vec3& e0 = p[(i + 1) % 3];
+        const glm::vec3& e1 = p[(i + 2) % 3];
+        edgeX[i] = e0.y - e1.y;
+        edgeY[i] = e1.x - e0.x;
+        edgeC[i] = e0.x * e1.y - e0.y * e1.x;
+    }
+
+    // The plane is anchored at a corner, summing the edge constants cancels badly on small triangles
+    float invArea = 1.0f / area;
+    float depthX = (edgeX[1] * (p[1].z - p[0].z) + edgeX[2] * (p[2].z - p[0].z)) * invArea;
+    float depthY = (edgeY[1] * (p[1].z - p[0].z) + edgeY[2] * (p[2].z - p[0].z)) * invArea;
+    float depthC = p[0].z - depthX * p[0].x - depthY * p[0].y;
+
+    // Samples at pixel centers, four pixels of a row per step. Edges are evaluated from scratch at every
+    // sample rather than stepped, so a shared edge gives exactly opposite values on its two triangles and
+    // closed meshes rasterize without cracks
+#ifdef OCCLUSION_SSE2
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 slopeX[3];
+    for (int i = 0; i < 3; ++i)
+        slopeX[i] = _mm_set1_ps(edgeX[i]);
+    __m128 slopeDepth = _mm_set1_ps(depthX);
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float sampleY = y + 0.5f;
+        __m128 row[3];
+        for (int i = 0; i < 3; ++i)
+            row[i] = _mm_set1_ps(edgeY[i] * sampleY + edgeC[i]);
+        __m128 rowDepth = _mm_set1_ps(depthY * sampleY + depthC);
+
+        float* pRow = &depths[(size_t)y * width];
+        for (int x = minX; x <= maxX; x += 4)
+        {
+            __m128 sampleX = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(slopeX[0], sampleX), row[0]);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(slopeX[1], sampleX), row[1]);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(slopeX[2], sampleX), row[2]);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(slopeDepth, sampleX), rowDepth);
+            __m128 depth = _mm_loadu_ps(pRow + x);
+            __m128 nearer = _mm_min_ps(depth, _mm_max_ps(_mm_min_ps(z, one), zero));
+            _mm_storeu_ps(pRow + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth)));
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float sampleY = y + 0.5f;
+        float* pRow = &depths[(size_t)y * width];
+        for (int x = minX; x <= maxX; ++x)
+        {
+            float sampleX = x + 0.5f;
+            if (edgeX[0] * sampleX + (edgeY[0] * sampleY + edgeC[0]) < 0.0f ||
+                edgeX[1] * sampleX + (edgeY[1] * sampleY + edgeC[1]) < 0.0f ||
+                edgeX[2] * sampleX + (edgeY[2] * sampleY + edgeC[2]) < 0.0f)
+                continue;
+
+            float z = depthX * sampleX + (depthY * sampleY + depthC);
+            pRow[x] = std::min(pRow[x], std::max(std::min(z, 1.0f), 0.0f));
+        }
+    }
+#endif
+}
+
+void OcclusionBuffer::End()
+{
+    levels.clear();
+    if (width == 0 || height == 0)
+        return;
+
+    Level level = { 0, width, height };
+    levels.push_back(level);
+    while (level.width > 1 || level.height > 1)
+    {
+        Level next = { depths.size(), std::max((level.width + 1) / 2, 1), std::max((level.height + 1) / 2, 1) };
+        depths.resize(next.offset + (size_t)next.width * next.height);
+
+        // Odd edges fold their last row or column in twice, which changes nothing for a max
+        const float* pSrc = &depths[level.offset];
+        float* pDst = &depths[next.offset];
+        for (int y = 0; y < next.height; ++y)
+        {
+            int y0 = y * 2;
+            int y1 = std::min(y0 + 1, level.height - 1);
+            for (int x = 0; x < next.width; ++x)
+            {
+                int x0 = x * 2;
+                int x1 = std::min(x0 + 1, level.width - 1);
+                float farthest = std::max(std::max(pSrc[y0 * level.width + x0], pSrc[y0 * level.width + x1]),
+                                          std::max(pSrc[y1 * level.width + x0], pSrc[y1 * level.width + x1]));
+                pDst[y * next.width + x] = farthest;
+            }
+        }
+
+        levels.push_back(next);
+        level = next;
+    }
+}
+
+bool OcclusionBuffer::IsVisible(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const
+{
+    if (levels.empty() || rasterized == 0)
+        return true;
+
+    // Screen rectangle and nearest depth of the corners, a box reaching behind the near plane is always kept
+    glm::vec2 rectMin = glm::vec2(1e30f);
+    glm::vec2 rectMax = glm::vec2(-1e30f);
+    float nearest = 1.0f;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner = glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+        glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+        if (clip.z < -clip.w || clip.w <= 0.0f)
+            return true;
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        rectMin = glm::min(rectMin, glm::vec2(ndc));
+        rectMax = glm::max(rectMax, glm::vec2(ndc));
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+
+    float x0 = std::max((rectMin.x * 0.5f + 0.5f) * width, 0.0f);
+    float x1 = std::min((rectMax.x * 0.5f + 0.5f) * width, width - 1.0f);
+    float y0 = std::max((rectMin.y * 0.5f + 0.5f) * height, 0.0f);
+    float y1 = std::min((rectMax.y * 0.5f + 0.5f) * height, height - 1.0f);
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    // The level where the rectangle covers at most two texels each way
+    float extent = std::max(x1 - x0, y1 - y0);
+    int index = extent > 1.0f ? (int)std::ceil(std::log2(extent)) : 0;
+    index = std::min(index, (int)levels.size() - 1);
+
+    const Level& level = levels[index];
+    int tx0 = std::min((int)x0 >> index, level.width - 1);
+    int tx1 = std::min((int)x1 >> index, level.width - 1);
+    int ty0 = std::min((int)y0 >> index, level.height - 1);
+    int ty1 = std::min((int)y1 >> index, level.height - 1);
+
+    const float* pLevel = &depths[level.offset];
+    for (int y = ty0; y <= ty1; ++y)
+    {
+        for (int x = tx0; x <= tx1; ++x)
+        {
+            if (nearest <= pLevel[y * level.width + x])
+                return true;
+        }
+    }
+    return false;
+}
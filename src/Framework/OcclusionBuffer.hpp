@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Generational handle to triangles kept on the CPU for the occlusion buffer, 0 is no occluder
+using Occluder = unsigned int;
+
+// Low resolution depth of the big occluders, rasterized on the CPU four pixels at a time so culling never
+// waits on the GPU and works without a context. A max pyramid over it answers box queries with a few reads
+class OcclusionBuffer
+{
+public:
+	// Any thread, the triangles are copied. Deleting leaves stale handles harmless, they rasterize nothing
+	static Occluder CreateOccluder(const glm::vec3* pPositions, size_t vertexCount, const unsigned int* pIndices, size_t indexCount);
+	static void DeleteOccluder(Occluder occluder);
+
+	// Width is rounded up to a multiple of 4
+	void Begin(int width, int height);
+	void Rasterize(Occluder occluder, const glm::mat4& mvp);
+	// Builds the pyramid, queries before the first End see everything
+	void End();
+
+	// Safe from several threads once End returned. False only when every occluder in front of the box is closer
+	bool IsVisible(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const;
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	size_t GetRasterizedCount() const { return rasterized; }
+
+private:
+	struct Level
+	{
+		size_t offset;
+		int width;
+		int height;
+	};
+
+	void RasterizeTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+
+	int width = 0;
+	int height = 0;
+	size_t rasterized = 0;
+
+	// Depth in [0, 1], level 0 is the raster target and each level above keeps the farthest of four
+	std::vector<float> depths;
+	std::vector<Level> levels;
+	std::vector<glm::vec4> clipped;
+};
@@ -0,0 +1,192 @@
+#include "ShaderCache.hpp"
+
+#include <Framework/Framework.hpp>
+#include <Framework/Utility.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#define ASSERT(expr) assert(expr)
+
+uint64_t HashFNV1a(const std::string& str, uint64_t hash = 14695981039346656037ull)
+{
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void MakeDirectory(const std::string& directory)
+{
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+ShaderCache::~ShaderCache()
+{
+    // Programs belong to a context that is gone by now, Clear has to run while it is current
+    ASSERT(programs.empty());
+}
+
+void ShaderCache::SetDirectory(const std::string& directory)
+{
+    this->directory = directory;
+}
+
+Shader ShaderCache::Load(const std::string& vPath, const std::string& pPath, const std::vector<std::string>& defines)
+{
+    std::vector<std::string> sorted = defines;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    std::string name = vPath + "|" + pPath;
+    for (size_t i = 0; i < sorted.size(); ++i)
+        name += "|" + sorted[i];
+
+    auto variant = variants.find(name);
+    if (variant != variants.end())
+        return variant->second;
+
+    std::string vSrc = Utility::InjectDefines(Utility::LoadTextFile(vPath), sorted);
+    std::string pSrc = Utility::InjectDefines(Utility::LoadTextFile(pPath), sorted);
+
+    // Defines a stage ignores still change its text, so only truly identical sources share a program
+    uint64_t hash = HashFNV1a(pSrc, HashFNV1a(vSrc));
+
+    auto existing = hashes.find(hash);
+    if (existing != hashes.end())
+        return variants[name] = programs[existing->second].shader;
+
+    Program program;
+    program.shader = Build(hash, vSrc, pSrc);
+    program.hash = hash;
+    program.vPath = vPath;
+    program.pPath = pPath;
+    program.defines = sorted;
+
+    hashes[hash] = programs.size();
+    programs.push_back(program);
+
+    WatchFile(vPath);
+    WatchFile(pPath);
+
+    return variants[name] = program.shader;
+}
+
+void ShaderCache::Reload(const std::string& filepath)
+{
+    for (size_t i = 0; i < programs.size(); ++i)
+    {
+        Program& program = programs[i];
+        if (program.vPath != filepath && program.pPath != filepath)
+            continue;
+
+        std::string vSrc = Utility::InjectDefines(Utility::LoadTextFile(program.vPath), program.defines);
+        std::string pSrc = Utility::InjectDefines(Utility::LoadTextFile(program.pPath), program.defines);
+        if (!Graphics::RebuildShader(program.shader, vSrc.c_str(), pSrc.c_str()))
+        {
+            std::cerr << "Keeping the previous build of " << program.vPath << " and " << program.pPath << std::endl;
+            continue;
+        }
+
+        if (hashes[program.hash] == i)
+            hashes.erase(program.hash);
+        program.hash = HashFNV1a(pSrc, HashFNV1a(vSrc));
+        hashes[program.hash] = i;
+
+        if (!directory.empty() && Graphics::IsShaderBinarySupported())
+            SaveBinary(program.shader, program.hash);
+    }
+}
+
+void ShaderCache::Clear()
+{
+    for (size_t i = 0; i < programs.size(); ++i)
+        Graphics::DeleteShader(programs[i].shader);
+
+    programs.clear();
+    hashes.clear();
+    variants.clear();
+}
+
+size_t ShaderCache::GetProgramCount() const
+{
+    return programs.size();
+}
+
+Shader ShaderCache::Build(uint64_t hash, const std::string& vSrc, const std::string& pSrc)
+{
+    bool diskCache = !directory.empty() && Graphics::IsShaderBinarySupported();
+    if (diskCache)
+    {
+        std::ifstream file(GetBinaryPath(hash), std::ios::binary);
+        unsigned int binaryFormat = 0;
+        if (file.read((char*)&binaryFormat, sizeof(binaryFormat)))
+        {
+            std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            Shader program = Graphics::CreateShader(binaryFormat, binary);
+            if (program != 0)
+                return program;
+        }
+    }
+
+    Shader program = Graphics::CreateShader(vSrc.c_str(), pSrc.c_str(), nullptr);
+    if (diskCache)
+        SaveBinary(program, hash);
+
+    return program;
+}
+
+void ShaderCache::SaveBinary(Shader shader, uint64_t hash)
+{
+    unsigned int binaryFormat = 0;
+    std::vector<unsigned char> binary;
+    if (!Graphics::GetShaderBinary(shader, binaryFormat, binary))
+        return;
+
+    MakeDirectory(directory);
+
+    std::ofstream file(GetBinaryPath(hash), std::ios::binary);
+    file.write((const char*)&binaryFormat, sizeof(binaryFormat));
+    file.write((const char*)binary.data(), binary.size());
+    if (!file)
+        std::cerr << "Failed to write shader binary " << GetBinaryPath(hash) << std::endl;
+}
+
+void ShaderCache::WatchFile(const std::string& filepath)
+{
+    if (!watched.insert(filepath).second)
+        return;
+
+    // The watcher calls back on the main thread, relinking waits for the GL thread
+    Engine::Files().Watch(filepath, [this, filepath]()
+    {
+        Engine::Defer([this, filepath]() { Reload(filepath); });
+    });
+}
+
+std::string ShaderCache::GetBinaryPath(uint64_t hash)
+{
+    if (driverInfo.empty())
+        driverInfo = Graphics::GetDriverInfo();
+
+    // Binaries only load on the driver that wrote them, so it is part of the name
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)HashFNV1a(driverInfo, hash));
+    return directory + "/" + name;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Framework/Graphics.hpp>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Builds shader variants from #define permutations, shares identical programs and keeps linked binaries on disk
+class ShaderCache
+{
+public:
+	~ShaderCache();
+
+	// Binaries are written here when the driver can return them, empty disables the disk cache
+	void SetDirectory(const std::string& directory);
+
+	// GL thread, define order does not matter
+	Shader Load(const std::string& vPath, const std::string& pPath, const std::vector<std::string>& defines = std::vector<std::string>());
+
+	// GL thread, relinks every program built from the file in place so handles stay valid
+	void Reload(const std::string& filepath);
+
+	// GL thread, deletes every program handed out
+	void Clear();
+
+	size_t GetProgramCount() const;
+
+private:
+	struct Program
+	{
+		Shader shader = 0;
+		uint64_t hash = 0;
+		std::string vPath;
+		std::string pPath;
+		std::vector<std::string> defines;
+	};
+
+	Shader Build(uint64_t hash, const std::string& vSrc, const std::string& pSrc);
+	void SaveBinary(Shader shader, uint64_t hash);
+	std::string GetBinaryPath(uint64_t hash);
+	void WatchFile(const std::string& filepath);
+
+	std::string directory = "cache";
+	std::string driverInfo;
+
+	// Variants are looked up by name first, programs by the hash of their final sources
+	std::map<std::string, Shader> variants;
+	std::map<uint64_t, size_t> hashes;
+	std::vector<Program> programs;
+	std::set<std::string> watched;
+};
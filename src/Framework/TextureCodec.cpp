@@ -0,0 +1,622 @@
+#include "TextureCodec.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#define ASSERT(expr) assert(expr)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_CODEC_SSE2
+#endif
+
+// KTX 1.1, level sizes follow the header and each level is padded to four bytes
+static const unsigned char ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t ktxEndianness = 0x04030201;
+// Key/value entry recording whether the source had any see-through pixel, the value is "0" or "1"
+static const char ktxAlphaKey[] = "alpha";
+
+struct KtxHeader
+{
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// GL enum values, kept numeric so the baker does not need a GL loader
+struct KtxFormat
+{
+    TextureFormat format;
+    uint32_t glType;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+};
+
+static const KtxFormat ktxFormats[] =
+{
+    { TextureFormat::RBG24, 0x1401, 0x1907, 0x8051, 0x1907 },
+    { TextureFormat::RBGA32, 0x1401, 0x1908, 0x8058, 0x1908 },
+    { TextureFormat::BC1, 0, 0, 0x83F0, 0x1907 },
+    { TextureFormat::BC3, 0, 0, 0x83F3, 0x1908 },
+    { TextureFormat::BC5, 0, 0, 0x8DBD, 0x8227 },
+    { TextureFormat::BC7, 0, 0, 0x8E8C, 0x1908 },
+};
+
+// Little endian bit stream used to pack block indices and BC7 fields
+struct BitWriter
+{
+    unsigned char* pData;
+    int position = 0;
+
+    explicit BitWriter(unsigned char* pData) : pData(pData) {}
+
+    void Write(uint32_t value, int bits)
+    {
+        for (int i = 0; i < bits; ++i, ++position)
+            pData[position >> 3] |= ((value >> i) & 1) << (position & 7);
+    }
+};
+
+void FetchBlock(int width, int height, const unsigned char* rgba, int bx, int by, unsigned char block[16][4])
+{
+    for (int y = 0; y < 4; ++y)
+    {
+        int py = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x)
+        {
+            int px = std::min(bx * 4 + x, width - 1);
+            std::memcpy(block[y * 4 + x], rgba + (py * width + px) * 4, 4);
+        }
+    }
+}
+
+void FindEndpoints(const unsigned char block[16][4], int channels, float minColor[4], float maxColor[4])
+{
+    // Endpoints are the extremes of the block along its principal axis
+    float mean[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < channels; ++c)
+            mean[c] += block[i][c] / 16.0f;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+    float axis[4] = { 1, 1, 1, 1 };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = { 0, 0, 0, 0 };
+        float length = 0;
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length = std::max(length, std::fabs(next[a]));
+        }
+
+        if (length == 0)
+            break;
+
+        for (int a = 0; a < channels; ++a)
+            axis[a] = next[a] / length;
+    }
+
+    float lengthSq = 0;
+    for (int c = 0; c < channels; ++c)
+        lengthSq += axis[c] * axis[c];
+
+    float tMin = 0, tMax = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0;
+        for (int c = 0; c < channels; ++c)
+            t += (block[i][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    for (int c = 0; c < channels; ++c)
+    {
+        minColor[c] = std::min(std::max(mean[c] + axis[c] * tMin / lengthSq, 0.0f), 255.0f);
+        maxColor[c] = std::min(std::max(mean[c] + axis[c] * tMax / lengthSq, 0.0f), 255.0f);
+    }
+}
+
+int ColorDistance(const unsigned char* a, const int* b, int channels)
+{
+    int distance = 0;
+    for (int c = 0; c < channels; ++c)
+        distance += (a[c] - b[c]) * (a[c] - b[c]);
+    return distance;
+}
+
+uint16_t To565(const float color[4])
+{
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void From565(uint16_t color, int out[3])
+{
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+void EncodeColorBlock(const unsigned char block[16][4], unsigned char* out)
+{
+    float minColor[4], maxColor[4];
+    FindEndpoints(block, 3, minColor, maxColor);
+
+    uint16_t c0 = To565(maxColor);
+    uint16_t c1 = To565(minColor);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    // c0 > c1 selects the four color mode, equal endpoints encode a flat block with index 0
+    int palette[4][3];
+    From565(c0, palette[0]);
+    From565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0;
+            int bestDistance = ColorDistance(block[i], palette[0], 3);
+            for (int j = 1; j < 4; ++j)
+            {
+                int distance = ColorDistance(block[i], palette[j], 3);
+                if (distance < bestDistance)
+                {
+                    best = j;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+void EncodeChannelBlock(const unsigned char block[16][4], int channel, unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        a0 = std::max<int>(a0, block[i][channel]);
+        a1 = std::min<int>(a1, block[i][channel]);
+    }
+
+    // a0 > a1 selects the eight value mode
+    int palette[8] = { a0, a1 };
+    for (int j = 2; j < 8; ++j)
+        palette[j] = ((8 - j) * a0 + (j - 1) * a1) / 7;
+
+    std::memset(out, 0, 8);
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    if (a0 == a1)
+        return;
+
+    BitWriter writer(out + 2);
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        int bestDistance = 256;
+        for (int j = 0; j < 8; ++j)
+        {
+            int distance = std::abs(block[i][channel] - palette[j]);
+            if (distance < bestDistance)
+            {
+                best = j;
+                bestDistance = distance;
+            }
+        }
+        writer.Write(best, 3);
+    }
+}
+
+void EncodeBC7Block(const unsigned char block[16][4], unsigned char* out)
+{
+    // Mode 6: one subset, 7 bit RGBA endpoints with a p-bit each and 4 bit indices
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float endpoints[2][4];
+    FindEndpoints(block, 4, endpoints[0], endpoints[1]);
+
+    int quantized[2][4];
+    int pbits[2];
+    int colors[2][4];
+    for (int e = 0; e < 2; ++e)
+    {
+        // Pick the p-bit that lands the endpoint closest to the ideal color
+        int bestError = INT32_MAX;
+        for (int p = 0; p < 2; ++p)
+        {
+            int error = 0;
+            int candidate[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                candidate[c] = std::min(std::max((int)((endpoints[e][c] - p) / 2.0f + 0.5f), 0), 127);
+                int value = (candidate[c] << 1) | p;
+                error += (int)((value - endpoints[e][c]) * (value - endpoints[e][c]));
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                std::memcpy(quantized[e], candidate, sizeof(candidate));
+            }
+        }
+
+        for (int c = 0; c < 4; ++c)
+            colors[e][c] = (quantized[e][c] << 1) | pbits[e];
+    }
+
+    int palette[16][4];
+    for (int j = 0; j < 16; ++j)
+        for (int c = 0; c < 4; ++c)
+            palette[j][c] = ((64 - weights[j]) * colors[0][c] + weights[j] * colors[1][c] + 32) >> 6;
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        int bestDistance = INT32_MAX;
+        for (int j = 0; j < 16; ++j)
+        {
+            int distance = ColorDistance(block[i], palette[j], 4);
+            if (distance < bestDistance)
+            {
+                best = j;
+                bestDistance = distance;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // The anchor index drops its top bit, so it must be below 8, swapping the endpoints flips every index
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; ++c)
+            std::swap(quantized[0][c], quantized[1][c]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer(out);
+    writer.Write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.Write(quantized[0][c], 7);
+        writer.Write(quantized[1][c], 7);
+    }
+    writer.Write(pbits[0], 1);
+    writer.Write(pbits[1], 1);
+    writer.Write(indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        writer.Write(indices[i], 4);
+}
+
+void TextureCodec::Encode(TextureFormat format, int width, int height, const unsigned char* rgba, std::vector<unsigned char>& out)
+{
+    ASSERT(Graphics::IsTextureFormatCompressed(format));
+
+    out.resize(Graphics::GetTextureSize(format, width, height));
+    int blockSize = format == TextureFormat::BC1 ? 8 : 16;
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+
+    unsigned char block[16][4];
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            FetchBlock(width, height, rgba, bx, by, block);
+            unsigned char* pOut = &out[(by * blocksX + bx) * blockSize];
+
+            switch (format)
+            {
+            case TextureFormat::BC1: EncodeColorBlock(block, pOut); break;
+            case TextureFormat::BC3: EncodeChannelBlock(block, 3, pOut); EncodeColorBlock(block, pOut + 8); break;
+            case TextureFormat::BC5: EncodeChannelBlock(block, 0, pOut); EncodeChannelBlock(block, 1, pOut + 8); break;
+            case TextureFormat::BC7: EncodeBC7Block(block, pOut); break;
+            default: break;
+            }
+        }
+    }
+}
+
+struct ColorTables
+{
+    float toLinear[256];
+    unsigned char toSrgb[4096];
+
+    ColorTables()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        for (int i = 0; i < 4096; ++i)
+        {
+            float c = i / 4095.0f;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = (unsigned char)(std::min(std::max(s, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    }
+};
+
+static const ColorTables colorTables;
+
+void ToLinear(int count, const unsigned char* rgba, bool srgb, std::vector<float>& out)
+{
+    out.resize(count * 4);
+    for (int i = 0; i < count * 4; ++i)
+        out[i] = srgb && (i & 3) != 3 ? colorTables.toLinear[rgba[i]] : rgba[i] / 255.0f;
+}
+
+void FromLinear(int count, const float* linear, bool srgb, std::vector<unsigned char>& out)
+{
+    out.resize(count * 4);
+    for (int i = 0; i < count * 4; ++i)
+    {
+        float c = std::min(std::max(linear[i], 0.0f), 1.0f);
+        out[i] = srgb && (i & 3) != 3 ? colorTables.toSrgb[(int)(c * 4095.0f + 0.5f)] : (unsigned char)(c * 255.0f + 0.5f);
+    }
+}
+
+void TextureCodec::Downsample(int width, int height, const float* linear, std::vector<float>& out)
+{
+    int outWidth = std::max(width / 2, 1);
+    int outHeight = std::max(height / 2, 1);
+    out.resize(outWidth * outHeight * 4);
+
+    for (int y = 0; y < outHeight; ++y)
+    {
+        const float* row0 = linear + std::min(y * 2, height - 1) * width * 4;
+        const float* row1 = linear + std::min(y * 2 + 1, height - 1) * width * 4;
+        float* pOut = &out[y * outWidth * 4];
+
+        for (int x = 0; x < outWidth; ++x)
+        {
+            int x0 = std::min(x * 2, width - 1) * 4;
+            int x1 = std::min(x * 2 + 1, width - 1) * 4;
+
+#ifdef TEXTURE_CODEC_SSE2
+            // One RGBA pixel per register, all four channels filtered at once
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)), _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(pOut + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; ++c)
+                pOut[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+        }
+    }
+}
+
+void TextureCodec::Bake(TextureFormat format, int width, int height, const unsigned char* rgba, bool srgb, TextureData& texture)
+{
+    texture.format = format;
+    texture.width = width;
+    texture.height = height;
+    texture.levels.clear();
+
+    texture.alpha = false;
+    for (int i = 0; i < width * height && !texture.alpha; ++i)
+        texture.alpha = rgba[i * 4 + 3] != 255;
+
+    // Every level is filtered from the float chain so rounding does not accumulate down the mips
+    std::vector<float> linear;
+    std::vector<float> next;
+    std::vector<unsigned char> level(rgba, rgba + width * height * 4);
+    ToLinear(width * height, rgba, srgb, linear);
+
+    while (true)
+    {
+        texture.levels.emplace_back();
+        if (Graphics::IsTextureFormatCompressed(format))
+            Encode(format, width, height, &level[0], texture.levels.back());
+        else
+            texture.levels.back() = level;
+
+        if (width == 1 && height == 1)
+            break;
+
+        Downsample(width, height, &linear[0], next);
+        linear.swap(next);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        FromLinear(width * height, &linear[0], srgb, level);
+    }
+}
+
+std::string TextureCodec::GetBakedPath(const std::string& filepath)
+{
+    size_t extension = filepath.find_last_of('.');
+    size_t separator = filepath.find_last_of("/\\");
+    if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+        return filepath + ".ktx";
+
+    return filepath.substr(0, extension) + ".ktx";
+}
+
+bool TextureCodec::Save(const std::string& filepath, const TextureData& texture)
+{
+    const KtxFormat* pFormat = nullptr;
+    for (size_t i = 0; i < sizeof(ktxFormats) / sizeof(ktxFormats[0]); ++i)
+        if (ktxFormats[i].format == texture.format)
+            pFormat = &ktxFormats[i];
+
+    // Uncompressed levels are written as RGBA, RGB rows would need padding
+    if (pFormat == nullptr || texture.format == TextureFormat::RBG24)
+        return false;
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file)
+        return false;
+
+    KtxHeader header;
+    std::memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+    header.endianness = ktxEndianness;
+    header.glType = pFormat->glType;
+    header.glTypeSize = 1;
+    header.glFormat = pFormat->glFormat;
+    header.glInternalFormat = pFormat->glInternalFormat;
+    header.glBaseInternalFormat = pFormat->glBaseInternalFormat;
+    header.pixelWidth = texture.width;
+    header.pixelHeight = texture.height;
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (uint32_t)texture.levels.size();
+    // One entry, key and value both end in a null and the entry is padded to four bytes
+    const char padding[4] = {};
+    const char* pValue = texture.alpha ? "1" : "0";
+    uint32_t keyValueSize = (uint32_t)(sizeof(ktxAlphaKey) + 2);
+    uint32_t keyValuePadding = (4 - keyValueSize % 4) % 4;
+    header.bytesOfKeyValueData = sizeof(keyValueSize) + keyValueSize + keyValuePadding;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)&keyValueSize, sizeof(keyValueSize));
+    file.write(ktxAlphaKey, sizeof(ktxAlphaKey));
+    file.write(pValue, 2);
+    file.write(padding, keyValuePadding);
+
+    for (size_t i = 0; i < texture.levels.size(); ++i)
+    {
+        uint32_t imageSize = (uint32_t)texture.levels[i].size();
+        file.write((const char*)&imageSize, sizeof(imageSize));
+        file.write((const char*)texture.levels[i].data(), imageSize);
+        file.write(padding, (4 - imageSize % 4) % 4);
+    }
+
+    return (bool)file;
+}
+
+bool TextureReader::Open(const std::string& filepath)
+{
+    file.open(filepath, std::ios::binary);
+    if (!file)
+        return false;
+
+    KtxHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0 || header.endianness != ktxEndianness)
+    {
+        std::cout << "Invalid texture file: " << filepath << std::endl;
+        return false;
+    }
+
+    const KtxFormat* pFormat = nullptr;
+    for (size_t i = 0; i < sizeof(ktxFormats) / sizeof(ktxFormats[0]); ++i)
+        if (ktxFormats[i].glInternalFormat == header.glInternalFormat)
+            pFormat = &ktxFormats[i];
+
+    if (pFormat == nullptr || header.pixelDepth > 1 || header.numberOfFaces != 1 || header.numberOfArrayElements > 0)
+    {
+        std::cout << "Unsupported texture file: " << filepath << std::endl;
+        return false;
+    }
+
+    format = pFormat->format;
+    width = header.pixelWidth;
+    height = header.pixelHeight;
+    levels = std::max<int>(header.numberOfMipmapLevels, 1);
+
+    alpha = format == TextureFormat::BC3 || format == TextureFormat::BC7 || format == TextureFormat::RBGA32;
+    std::vector<char> keyValueData(header.bytesOfKeyValueData);
+    if (!keyValueData.empty() && !file.read(keyValueData.data(), keyValueData.size()))
+    {
+        std::cout << "Invalid texture file: " << filepath << std::endl;
+        return false;
+    }
+
+    for (size_t offset = 0; offset + sizeof(uint32_t) <= keyValueData.size(); )
+    {
+        uint32_t size;
+        std::memcpy(&size, &keyValueData[offset], sizeof(size));
+        offset += sizeof(size);
+        if (size > keyValueData.size() - offset)
+            break;
+
+        const char* pKey = &keyValueData[offset];
+        if (size == sizeof(ktxAlphaKey) + 2 && std::memcmp(pKey, ktxAlphaKey, sizeof(ktxAlphaKey)) == 0)
+            alpha = pKey[sizeof(ktxAlphaKey)] == '1';
+        offset += size + (4 - size % 4) % 4;
+    }
+
+    // Level sizes follow from the format, so every offset is known without touching the data
+    offsets.resize(levels);
+    uint32_t offset = (uint32_t)sizeof(header) + header.bytesOfKeyValueData;
+    for (int i = 0; i < levels; ++i)
+    {
+        uint32_t imageSize = Graphics::GetTextureSize(format, GetLevelWidth(i), GetLevelHeight(i));
+        offsets[i] = offset;
+        offset += sizeof(uint32_t) + imageSize + (4 - imageSize % 4) % 4;
+    }
+
+    return true;
+}
+
+bool TextureReader::ReadLevel(int level, std::vector<unsigned char>& data)
+{
+    ASSERT(level >= 0 && level < levels);
+
+    uint32_t imageSize = 0;
+    file.clear();
+    file.seekg(offsets[level]);
+    if (!file.read((char*)&imageSize, sizeof(imageSize)) || imageSize != (uint32_t)Graphics::GetTextureSize(format, GetLevelWidth(level), GetLevelHeight(level)))
+        return false;
+
+    data.resize(imageSize);
+    return (bool)file.read((char*)data.data(), imageSize);
+}
+
+int TextureReader::GetLevelWidth(int level) const
+{
+    return std::max(width >> level, 1);
+}
+
+int TextureReader::GetLevelHeight(int level) const
+{
+    return std::max(height >> level, 1);
+}
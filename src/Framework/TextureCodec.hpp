@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Framework/Graphics.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Texture with its full mip chain already encoded in the upload format
+struct TextureData
+{
+	TextureFormat format = TextureFormat::RBGA32;
+	int width = 0;
+	int height = 0;
+	// Whether any source pixel is see-through, saved with the container so loading never needs the source
+	bool alpha = false;
+	std::vector<std::vector<unsigned char>> levels;
+};
+
+class TextureCodec
+{
+public:
+	// Encodes an RGBA8 image into the block compressed format, partial edge blocks repeat the last row and column
+	static void Encode(TextureFormat format, int width, int height, const unsigned char* rgba, std::vector<unsigned char>& out);
+
+	// Box filters a linear float RGBA image to half size
+	static void Downsample(int width, int height, const float* linear, std::vector<float>& out);
+
+	// Builds every level down to 1x1 from an RGBA8 image, filtering in linear space when the colour channels are sRGB
+	static void Bake(TextureFormat format, int width, int height, const unsigned char* rgba, bool srgb, TextureData& texture);
+
+	// Baked containers sit next to their source image with a .ktx extension
+	static std::string GetBakedPath(const std::string& filepath);
+
+	static bool Save(const std::string& filepath, const TextureData& texture);
+};
+
+// Reads a baked KTX container one level at a time so levels can go straight to the GPU
+class TextureReader
+{
+public:
+	bool Open(const std::string& filepath);
+	bool ReadLevel(int level, std::vector<unsigned char>& data);
+
+	int GetLevelWidth(int level) const;
+	int GetLevelHeight(int level) const;
+
+	TextureFormat format = TextureFormat::RBGA32;
+	int width = 0;
+	int height = 0;
+	int levels = 0;
+	// Containers baked without the flag count formats that can store alpha as having it
+	bool alpha = false;
+
+private:
+	std::ifstream file;
+	std::vector<unsigned int> offsets;
+};
@@ -0,0 +1,329 @@
+#include "TextureStreamer.hpp"
+
+#include <Framework/Framework.hpp>
+#include <Framework/TextureCodec.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+#define ASSERT(expr) assert(expr)
+
+// Levels at or below this size on their larger side are loaded up front and never evicted
+static const int tailSize = 64;
+
+TextureStreamer::~TextureStreamer()
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+        delete entries[i];
+    for (size_t i = 0; i < added.size(); ++i)
+        delete added[i];
+}
+
+void TextureStreamer::Release()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Graphics::DeleteTexture(1, entries[i]->texture);
+        entries[i]->texture = 0;
+    }
+    for (size_t i = 0; i < added.size(); ++i)
+    {
+        Graphics::DeleteTexture(1, added[i]->texture);
+        added[i]->texture = 0;
+    }
+    lookup.clear();
+    residentBytes = 0;
+}
+
+void TextureStreamer::SetBudget(size_t bytes)
+{
+    budget = bytes;
+}
+
+size_t TextureStreamer::GetResidentBytes() const
+{
+    return residentBytes;
+}
+
+Texture TextureStreamer::Load(const std::string& filepath)
+{
+    TextureReader reader;
+    if (!reader.Open(filepath) || !Graphics::IsTextureFormatSupported(reader.format))
+        return 0;
+
+    int tail = 0;
+    while (tail < reader.levels - 1 && std::max(reader.GetLevelWidth(tail), reader.GetLevelHeight(tail)) > tailSize)
+        tail++;
+
+    Texture texture = Graphics::CreateTexture(1);
+    std::vector<unsigned char> data;
+    size_t bytes = 0;
+    for (int level = tail; level < reader.levels; ++level)
+    {
+        if (!reader.ReadLevel(level, data))
+        {
+            Graphics::DeleteTexture(1, texture);
+            return 0;
+        }
+
+        Graphics::UpdateTexture(texture, reader.format, level, reader.GetLevelWidth(level), reader.GetLevelHeight(level), &data[0]);
+        bytes += data.size();
+    }
+
+    Graphics::SetTextureLevels(texture, tail, reader.levels - 1);
+    Graphics::FilterTexture(texture, TextureWrap::REPEAT, TextureWrap::REPEAT, TextureFilter::LINEAR_LINEAR, TextureFilter::LINEAR);
+
+    Entry* pEntry = new Entry();
+    pEntry->texture = texture;
+    pEntry->filepath = filepath;
+    pEntry->format = reader.format;
+    pEntry->width = reader.width;
+    pEntry->height = reader.height;
+    pEntry->levels = reader.levels;
+    pEntry->tailLevel = tail;
+    pEntry->residentLevel = tail;
+    pEntry->wantedLevel = tail;
+    pEntry->tailBytes = bytes;
+
+    // Entries belong to the main thread, the next Update takes this one over
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        added.push_back(pEntry);
+    }
+
+    Engine::Files().Watch(filepath, [this, filepath]() { Reload(filepath); });
+
+    return texture;
+}
+
+bool TextureStreamer::Reload(const std::string& filepath)
+{
+    Entry* pEntry = nullptr;
+    for (size_t i = 0; i < entries.size() && pEntry == nullptr; ++i)
+    {
+        if (entries[i]->filepath == filepath)
+            pEntry = entries[i];
+    }
+
+    if (pEntry == nullptr)
+        return false;
+
+    // A read of the old file is still in flight, Update retries once it lands
+    Entry& entry = *pEntry;
+    if (entry.loadingLevel >= 0)
+    {
+        entry.stale = true;
+        return true;
+    }
+    entry.stale = false;
+
+    TextureReader reader;
+    if (!reader.Open(filepath) || reader.format != entry.format || reader.width != entry.width || reader.height != entry.height || reader.levels != entry.levels)
+    {
+        std::cerr << "Cannot reload " << filepath << " in place, its format or size changed" << std::endl;
+        return false;
+    }
+    entry.failed = false;
+
+    // Drop back to the tail and let streaming bring the finer levels in again from the new file
+    if (entry.residentLevel < entry.tailLevel)
+    {
+        Eviction eviction;
+        eviction.pEntry = &entry;
+        eviction.fromLevel = entry.residentLevel;
+        eviction.toLevel = entry.tailLevel;
+        for (int level = entry.residentLevel; level < entry.tailLevel; ++level)
+            residentBytes -= GetLevelBytes(entry, level);
+        entry.residentLevel = entry.tailLevel;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        evictions.push_back(eviction);
+    }
+
+    for (int level = entry.tailLevel; level < entry.levels; ++level)
+    {
+        LevelData read;
+        read.pEntry = &entry;
+        read.level = level;
+        read.refresh = true;
+        read.valid = reader.ReadLevel(level, read.data);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        reads.push_back(std::move(read));
+    }
+
+    return true;
+}
+
+void TextureStreamer::Request(Texture texture, float pixels)
+{
+    std::unordered_map<Texture, Entry*>::const_iterator it = lookup.find(texture);
+    if (it == lookup.end())
+        return;
+
+    Entry& entry = *it->second;
+    float size = (float)std::max(entry.width, entry.height);
+    int level = (int)std::floor(std::log2(size / std::max(pixels, 1.0f)));
+    level = std::min(std::max(level, 0), entry.tailLevel);
+
+    int wanted = entry.wantedLevel.load();
+    while (level < wanted && !entry.wantedLevel.compare_exchange_weak(wanted, level));
+
+    entry.lastUsed.store(frame);
+}
+
+void TextureStreamer::Update()
+{
+    std::vector<LevelData> done;
+    std::vector<Entry*> loaded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(uploaded);
+        loaded.swap(added);
+    }
+
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        entries.push_back(loaded[i]);
+        lookup[loaded[i]->texture] = loaded[i];
+        residentBytes += loaded[i]->tailBytes;
+    }
+
+    for (size_t i = 0; i < done.size(); ++i)
+    {
+        Entry& entry = *done[i].pEntry;
+        entry.loadingLevel = -1;
+
+        if (done[i].valid)
+        {
+            entry.residentLevel = done[i].level;
+        }
+        else
+        {
+            // Stop streaming this texture instead of retrying every frame
+            std::cerr << "Cannot read level " << done[i].level << " of " << entry.filepath << std::endl;
+            residentBytes -= GetLevelBytes(entry, done[i].level);
+            entry.failed = true;
+        }
+
+        if (entry.stale)
+            Reload(entry.filepath);
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Entry& entry = *entries[i];
+        int wanted = entry.wantedLevel.exchange(entry.tailLevel);
+        if (entry.failed || entry.loadingLevel >= 0 || wanted >= entry.residentLevel)
+            continue;
+
+        // Step one level finer per read so detail sharpens progressively
+        int level = entry.residentLevel - 1;
+        size_t bytes = GetLevelBytes(entry, level);
+        if (residentBytes + bytes > budget)
+        {
+            Evict(bytes);
+            if (residentBytes + bytes > budget)
+                continue;
+        }
+
+        residentBytes += bytes;
+        entry.loadingLevel = level;
+
+        Entry* pEntry = &entry;
+        Engine::Jobs().Run("TextureStreamer::Read", [this, pEntry, level]()
+        {
+            LevelData read;
+            read.pEntry = pEntry;
+            read.level = level;
+            read.refresh = false;
+
+            TextureReader reader;
+            read.valid = reader.Open(pEntry->filepath) && reader.ReadLevel(level, read.data);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            reads.push_back(std::move(read));
+        });
+    }
+
+    frame++;
+}
+
+void TextureStreamer::Upload()
+{
+    std::vector<Eviction> evicted;
+    std::vector<LevelData> loaded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        evicted.swap(evictions);
+        loaded.swap(reads);
+    }
+
+    // Evictions were decided before any read that is still queued, so they go first
+    for (size_t i = 0; i < evicted.size(); ++i)
+    {
+        const Entry& entry = *evicted[i].pEntry;
+        Graphics::SetTextureLevels(entry.texture, evicted[i].toLevel, entry.levels - 1);
+        for (int level = evicted[i].fromLevel; level < evicted[i].toLevel; ++level)
+            Graphics::ReleaseTextureLevel(entry.texture, level);
+    }
+
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        const Entry& entry = *loaded[i].pEntry;
+        int level = loaded[i].level;
+        if (loaded[i].valid)
+        {
+            Graphics::UpdateTexture(entry.texture, entry.format, level, std::max(entry.width >> level, 1), std::max(entry.height >> level, 1), &loaded[i].data[0]);
+            if (!loaded[i].refresh)
+                Graphics::SetTextureLevels(entry.texture, level, entry.levels - 1);
+        }
+
+        // Only the outcome travels back to the main thread
+        std::vector<unsigned char>().swap(loaded[i].data);
+    }
+
+    // Refreshed tail levels were never in flight as far as the main thread is concerned
+    loaded.erase(std::remove_if(loaded.begin(), loaded.end(), [](const LevelData& read) { return read.refresh; }), loaded.end());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uploaded.insert(uploaded.end(), loaded.begin(), loaded.end());
+}
+
+size_t TextureStreamer::GetLevelBytes(const Entry& entry, int level) const
+{
+    return Graphics::GetTextureSize(entry.format, std::max(entry.width >> level, 1), std::max(entry.height >> level, 1));
+}
+
+void TextureStreamer::Evict(size_t required)
+{
+    // Least recently used first, textures needed this frame or still loading are left alone
+    std::vector<Entry*> candidates;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Entry* pEntry = entries[i];
+        if (pEntry->lastUsed.load() < frame && pEntry->loadingLevel < 0 && pEntry->residentLevel < pEntry->tailLevel)
+            candidates.push_back(pEntry);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Entry* a, const Entry* b) { return a->lastUsed.load() < b->lastUsed.load(); });
+
+    for (size_t i = 0; i < candidates.size() && residentBytes + required > budget; ++i)
+    {
+        Entry& entry = *candidates[i];
+
+        Eviction eviction;
+        eviction.pEntry = &entry;
+        eviction.fromLevel = entry.residentLevel;
+        while (entry.residentLevel < entry.tailLevel && residentBytes + required > budget)
+            residentBytes -= GetLevelBytes(entry, entry.residentLevel++);
+        eviction.toLevel = entry.residentLevel;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        evictions.push_back(eviction);
+    }
+}
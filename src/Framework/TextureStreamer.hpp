@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Framework/Graphics.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the small tail of every baked mip chain resident and streams the larger levels in on demand
+class TextureStreamer
+{
+public:
+	~TextureStreamer();
+
+	void SetBudget(size_t bytes);
+	size_t GetResidentBytes() const;
+
+	// GL thread, returns 0 when there is no baked container to stream from
+	Texture Load(const std::string& filepath);
+
+	// Main thread, picks up a rebaked container in place when its format and size are unchanged
+	bool Reload(const std::string& filepath);
+
+	// Any thread during a frame, asks for enough detail to cover the given number of pixels
+	void Request(Texture texture, float pixels);
+
+	// Main thread once per frame after all requests, schedules reads and evictions
+	void Update();
+
+	// GL thread, applies finished reads and evictions
+	void Upload();
+
+	// GL thread at shutdown, deletes every streamed texture, reads still in flight are dropped by the destructor
+	void Release();
+
+private:
+	struct Entry
+	{
+		Texture texture = 0;
+		std::string filepath;
+		TextureFormat format = TextureFormat::RBGA32;
+		int width = 0;
+		int height = 0;
+		int levels = 0;
+
+		// Levels from tailLevel down are always resident, residentLevel is the finest level currently loaded
+		int tailLevel = 0;
+		int residentLevel = 0;
+		int loadingLevel = -1;
+		size_t tailBytes = 0;
+		bool stale = false;
+		// A read of the container failed, it stays at the levels it has until the file is rebaked
+		bool failed = false;
+
+		std::atomic<int> wantedLevel{ 0 };
+		std::atomic<unsigned int> lastUsed{ 0 };
+	};
+
+	struct LevelData
+	{
+		Entry* pEntry;
+		int level;
+		bool valid;
+		bool refresh;
+		std::vector<unsigned char> data;
+	};
+
+	struct Eviction
+	{
+		Entry* pEntry;
+		int fromLevel;
+		int toLevel;
+	};
+
+	size_t GetLevelBytes(const Entry& entry, int level) const;
+	void Evict(size_t required);
+
+	std::vector<Entry*> entries;
+	std::unordered_map<Texture, Entry*> lookup;
+
+	size_t budget = 256 * 1024 * 1024;
+	size_t residentBytes = 0;
+	unsigned int frame = 1;
+
+	// Handed between the job, GL and main threads
+	std::mutex mutex;
+	std::vector<Entry*> added;
+	std::vector<LevelData> reads;
+	std::vector<Eviction> evictions;
+	std::vector<LevelData> uploaded;
+};
@@ -1,38 +1,1697 @@
 #include "Utility.hpp"
 
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <Framework/TextureCodec.hpp>
+#include <Framework/Arena.hpp>
+#include <Framework/MeshSimplifier.hpp>
+
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
-#include <SFML/Graphics.hpp>
+#include <SFML/Graphics.hpp>
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <streambuf>
+#include <istream>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OBJ_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define ASSERT(expr) assert(expr)
+
+FileView::~FileView()
+{
+    Close();
+}
+
+FileView::FileView(FileView&& other)
+{
+    *this = std::move(other);
+}
+
+FileView& FileView::operator=(FileView&& other)
+{
+    if (this != &other)
+    {
+        Close();
+        pData = other.pData;
+        size = other.size;
+        pMapping = other.pMapping;
+        other.pData = nullptr;
+        other.size = 0;
+        other.pMapping = nullptr;
+    }
+    return *this;
+}
+
+bool FileView::Open(const std::string& filepath)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = nullptr;
+    if (fileSize.QuadPart > 0)
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (mapping == nullptr && fileSize.QuadPart > 0)
+        return false;
+
+    if (mapping != nullptr)
+    {
+        pData = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (pData == nullptr)
+        {
+            CloseHandle(mapping);
+            return false;
+        }
+        pMapping = mapping;
+        size = (size_t)fileSize.QuadPart;
+    }
+#else
+    int file = open(filepath.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        close(file);
+        return false;
+    }
+
+    if (info.st_size > 0)
+    {
+        void* pMapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (pMapped != MAP_FAILED)
+        {
+            // Readers walk the file front to back, so let the kernel read ahead aggressively
+            madvise(pMapped, info.st_size, MADV_SEQUENTIAL);
+            pData = (const char*)pMapped;
+            pMapping = pMapped;
+            size = (size_t)info.st_size;
+        }
+    }
+    close(file);
+
+    if (pMapping == nullptr && info.st_size > 0)
+        return false;
+#endif
+
+    // Empty files cannot be mapped but are still valid
+    if (pData == nullptr)
+        pData = "";
+    return true;
+}
+
+void FileView::Close()
+{
+    if (pMapping != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(pData);
+        CloseHandle(pMapping);
+#else
+        munmap(pMapping, size);
+#endif
+    }
+
+    pData = nullptr;
+    size = 0;
+    pMapping = nullptr;
+}
+
+// Lets tinyobj read a mapped file through std::istream without copying it
+class ViewBuffer : public std::streambuf
+{
+public:
+    explicit ViewBuffer(const FileView& view)
+    {
+        char* pBegin = const_cast<char*>(view.GetData());
+        setg(pBegin, pBegin, pBegin + view.GetSize());
+    }
+};
+
+class MaterialViewReader : public tinyobj::MaterialReader
+{
+public:
+    explicit MaterialViewReader(const std::string& directory)
+        : directory(directory)
+    {}
+
+    virtual bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* matMap, std::string* warn, std::string* err)
+    {
+        FileView view;
+        if (!view.Open(directory.size() > 0 ? directory + "/" + matId : matId))
+        {
+            if (warn != nullptr)
+                *warn += "Material file " + matId + " not found in " + directory + "\n";
+            return false;
+        }
+
+        ViewBuffer buffer(view);
+        std::istream stream(&buffer);
+        tinyobj::LoadMtl(matMap, materials, &stream, warn, err);
+        return true;
+    }
+
+private:
+    std::string directory;
+};
+
+std::string Utility::LoadTextFile(const std::string& filepath)
+{
+    FileView view;
+    if (!view.Open(filepath))
+        return std::string();
+
+    return std::string(view.GetData(), view.GetSize());
+}
+
+std::string Utility::InjectDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+    if (defines.empty())
+        return source;
+
+    std::string block;
+    for (size_t i = 0; i < defines.size(); ++i)
+        block += "#define " + defines[i] + "\n";
+
+    // The version directive has to stay first
+    size_t pos = 0;
+    if (source.compare(0, 8, "#version") == 0)
+    {
+        pos = source.find('\n');
+        pos = pos == std::string::npos ? source.size() : pos + 1;
+    }
+    return source.substr(0, pos) + block + source.substr(pos);
+}
+
+Shader Utility::LoadShader(const std::string& vPath, const std::string& pPath, const std::vector<std::string>& defines)
+{
+    std::string vSrc = InjectDefines(LoadTextFile(vPath), defines);
+    std::string pSrc = InjectDefines(LoadTextFile(pPath), defines);
+    return Graphics::CreateShader(vSrc.c_str(), pSrc.c_str(), nullptr);
+}
+
+// OBJ files are parsed straight from the mapping. Vertex and face lines, which are nearly all of a
+// file, get dedicated loops; the rare commands reuse tinyobj's helpers. The result is the same as
+// tinyobj::LoadObj, including its warnings and leniencies
+
+#ifdef OBJ_SSE2
+int CountTrailingZeros(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// tinyobj ends a line at '\n' or '\r' and ignores everything after a '\0'
+const char* FindLineEnd(const char* p, const char* pEnd)
+{
+#ifdef OBJ_SSE2
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i nul = _mm_setzero_si128();
+    while (pEnd - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)), _mm_cmpeq_epi8(chunk, nul));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask != 0)
+            return p + CountTrailingZeros(mask);
+        p += 16;
+    }
+#endif
+    while (p < pEnd && *p != '\n' && *p != '\r' && *p != '\0')
+        ++p;
+    return p;
+}
+
+const char* FindNextLine(const char* p, const char* pEnd)
+{
+    while (p < pEnd && *p != '\n' && *p != '\r')
+        ++p;
+    return p;
+}
+
+inline bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool IsDigit(char c)
+{
+    return (unsigned int)(c - '0') < 10;
+}
+
+const char* SkipBlanks(const char* p, const char* pEnd)
+{
+    while (p < pEnd && IsBlank(*p))
+        ++p;
+    return p;
+}
+
+const char* FindBlank(const char* p, const char* pEnd)
+{
+    while (p < pEnd && !IsBlank(*p))
+        ++p;
+    return p;
+}
+
+const double exactPowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Accepts the same prefixes as tinyobj's tryParseDouble. Up to 15 significant digits and a power of ten
+// within 1e22 are both exact doubles, so one multiply or divide rounds correctly (Clinger's fast path);
+// longer numbers are left to tinyobj
+bool ParseDouble(const char* s, const char* pEnd, double& result)
+{
+    const char* p = s;
+    if (p >= pEnd)
+        return false;
+
+    bool negative = false;
+    if (*p == '+' || *p == '-')
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+
+    // ".5" and "-.5" have no integer part, otherwise at least one digit is required
+    if (!(p < pEnd && *p == '.'))
+    {
+        const char* pDigits = p;
+        for (; p < pEnd && IsDigit(*p); ++p)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        }
+        if (p == pDigits)
+            return false;
+    }
+
+    if (p < pEnd && *p == '.')
+    {
+        for (++p; p < pEnd && IsDigit(*p); ++p)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+            --scale;
+        }
+    }
+
+    if (p < pEnd && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p < pEnd && (*p == '+' || *p == '-'))
+        {
+            negativeExponent = *p == '-';
+            ++p;
+        }
+
+        const char* pDigits = p;
+        int exponent = 0;
+        for (; p < pEnd && IsDigit(*p); ++p)
+        {
+            if (exponent < 10000)
+                exponent = exponent * 10 + (*p - '0');
+        }
+        if (p == pDigits)
+            return false;
+        scale += negativeExponent ? -exponent : exponent;
+    }
+
+    if (digits > 15 || scale < -22 || scale > 22)
+        return tinyobj::tryParseDouble(s, pEnd, &result);
+
+    double value = (double)mantissa;
+    value = scale < 0 ? value / exactPowersOfTen[-scale] : value * exactPowersOfTen[scale];
+
+    // tinyobj's digit by digit sum is a few ulps off, which only shows once narrowed to float when the
+    // value sits right between two floats. Those rare cases take its path so the floats stay identical
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t belowFloat = bits & ((1ull << 29) - 1);
+    if (belowFloat > (1ull << 28) - 4096 && belowFloat < (1ull << 28) + 4096)
+        return tinyobj::tryParseDouble(s, pEnd, &result);
+
+    result = negative ? -value : value;
+    return true;
+}
+
+// Reads the next blank separated number, the token is consumed even when it is not one
+bool TryParseReal(const char*& p, const char* pEnd, float& value)
+{
+    p = SkipBlanks(p, pEnd);
+    const char* pToken = p;
+    p = FindBlank(p, pEnd);
+
+    double parsed;
+    if (!ParseDouble(pToken, p, parsed))
+        return false;
+    value = (float)parsed;
+    return true;
+}
+
+float ParseReal(const char*& p, const char* pEnd, float defaultValue)
+{
+    float value = defaultValue;
+    TryParseReal(p, pEnd, value);
+    return value;
+}
+
+// Same as atoi, including its saturation through long
+int ParseIndex(const char* p, const char* pEnd)
+{
+    while (p < pEnd && (IsBlank(*p) || *p == '\v' || *p == '\f'))
+        ++p;
+
+    bool negative = false;
+    if (p < pEnd && (*p == '+' || *p == '-'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    const unsigned long limit = negative ? 0ul - (unsigned long)std::numeric_limits<long>::min() : (unsigned long)std::numeric_limits<long>::max();
+    unsigned long value = 0;
+    for (; p < pEnd && IsDigit(*p); ++p)
+    {
+        unsigned long digit = (unsigned long)(*p - '0');
+        value = value > (limit - digit) / 10 ? limit : value * 10 + digit;
+    }
+    return (int)(negative ? (long)(0ul - value) : (long)value);
+}
+
+const char* FindIndexEnd(const char* p, const char* pEnd)
+{
+    while (p < pEnd && *p != '/' && !IsBlank(*p))
+        ++p;
+    return p;
+}
+
+// v, v/vt, v//vn or v/vt/vn, negative indices count back from the last element
+bool ParseTriple(const char*& p, const char* pEnd, int vCount, int vnCount, int vtCount, tinyobj::vertex_index_t& index)
+{
+    index = tinyobj::vertex_index_t(-1);
+    if (!tinyobj::fixIndex(ParseIndex(p, pEnd), vCount, &index.v_idx))
+        return false;
+
+    p = FindIndexEnd(p, pEnd);
+    if (p == pEnd || *p != '/')
+        return true;
+    ++p;
+
+    if (p < pEnd && *p == '/')
+    {
+        ++p;
+        if (!tinyobj::fixIndex(ParseIndex(p, pEnd), vnCount, &index.vn_idx))
+            return false;
+        p = FindIndexEnd(p, pEnd);
+        return true;
+    }
+
+    if (!tinyobj::fixIndex(ParseIndex(p, pEnd), vtCount, &index.vt_idx))
+        return false;
+
+    p = FindIndexEnd(p, pEnd);
+    if (p == pEnd || *p != '/')
+        return true;
+    ++p;
+
+    if (!tinyobj::fixIndex(ParseIndex(p, pEnd), vnCount, &index.vn_idx))
+        return false;
+    p = FindIndexEnd(p, pEnd);
+    return true;
+}
+
+// Faces of the current group stored back to back rather than one vector each
+struct FaceList
+{
+    std::vector<tinyobj::vertex_index_t> indices;
+    std::vector<unsigned int> counts;
+    std::vector<unsigned int> smoothingIds;
+
+    void Clear()
+    {
+        indices.clear();
+        counts.clear();
+        smoothingIds.clear();
+    }
+};
+
+void AddTriangle(tinyobj::shape_t& shape, const tinyobj::vertex_index_t* pIndices, int materialId, unsigned int smoothingId)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        tinyobj::index_t index;
+        index.vertex_index = pIndices[i].v_idx;
+        index.normal_index = pIndices[i].vn_idx;
+        index.texcoord_index = pIndices[i].vt_idx;
+        shape.mesh.indices.push_back(index);
+    }
+    shape.mesh.num_face_vertices.push_back(3);
+    shape.mesh.material_ids.push_back(materialId);
+    shape.mesh.smoothing_group_ids.push_back(smoothingId);
+}
+
+// tinyobj's ear clipping step for step, polygons have to split into the same triangles
+void TriangulateFace(tinyobj::shape_t& shape, const tinyobj::vertex_index_t* pFace, size_t count, int materialId, unsigned int smoothingId, const std::vector<float>& v, std::vector<tinyobj::vertex_index_t>& remaining)
+{
+    // Project onto the plane the first proper corner faces most
+    size_t axes[2] = { 1, 2 };
+    for (size_t k = 0; k < count; ++k)
+    {
+        size_t vi0 = size_t(pFace[k].v_idx);
+        size_t vi1 = size_t(pFace[(k + 1) % count].v_idx);
+        size_t vi2 = size_t(pFace[(k + 2) % count].v_idx);
+        if (3 * vi0 + 2 >= v.size() || 3 * vi1 + 2 >= v.size() || 3 * vi2 + 2 >= v.size())
+            continue;
+
+        float e0x = v[vi1 * 3 + 0] - v[vi0 * 3 + 0];
+        float e0y = v[vi1 * 3 + 1] - v[vi0 * 3 + 1];
+        float e0z = v[vi1 * 3 + 2] - v[vi0 * 3 + 2];
+        float e1x = v[vi2 * 3 + 0] - v[vi1 * 3 + 0];
+        float e1y = v[vi2 * 3 + 1] - v[vi1 * 3 + 1];
+        float e1z = v[vi2 * 3 + 2] - v[vi1 * 3 + 2];
+        float cx = std::fabs(e0y * e1z - e0z * e1y);
+        float cy = std::fabs(e0z * e1x - e0x * e1z);
+        float cz = std::fabs(e0x * e1y - e0y * e1x);
+        const float epsilon = std::numeric_limits<float>::epsilon();
+        if (cx > epsilon || cy > epsilon || cz > epsilon)
+        {
+            if (!(cx > cy && cx > cz))
+            {
+                axes[0] = 0;
+                if (cz > cx && cz > cy)
+                    axes[1] = 1;
+            }
+            break;
+        }
+    }
+
+    float area = 0.0f;
+    for (size_t k = 0; k < count; ++k)
+    {
+        size_t vi0 = size_t(pFace[k].v_idx);
+        size_t vi1 = size_t(pFace[(k + 1) % count].v_idx);
+        if (vi0 * 3 + axes[0] >= v.size() || vi0 * 3 + axes[1] >= v.size() || vi1 * 3 + axes[0] >= v.size() || vi1 * 3 + axes[1] >= v.size())
+            continue;
+
+        float v0x = v[vi0 * 3 + axes[0]];
+        float v0y = v[vi0 * 3 + axes[1]];
+        float v1x = v[vi1 * 3 + axes[0]];
+        float v1y = v[vi1 * 3 + axes[1]];
+        area += (v0x * v1y - v0y * v1x) * 0.5f;
+    }
+
+    remaining.assign(pFace, pFace + count);
+    size_t guess = 0;
+    size_t iterations = count;
+    size_t previousCount = count;
+    tinyobj::vertex_index_t ind[3];
+    float vx[3];
+    float vy[3];
+
+    // Gives up on polygons where a full turn finds no ear
+    while (remaining.size() > 3 && iterations > 0)
+    {
+        size_t n = remaining.size();
+        if (guess >= n)
+            guess -= n;
+
+        if (previousCount != n)
+        {
+            previousCount = n;
+            iterations = n;
+        }
+        else
+        {
+            --iterations;
+        }
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            ind[k] = remaining[(guess + k) % n];
+            size_t vi = size_t(ind[k].v_idx);
+            if (vi * 3 + axes[0] >= v.size() || vi * 3 + axes[1] >= v.size())
+            {
+                vx[k] = 0.0f;
+                vy[k] = 0.0f;
+            }
+            else
+            {
+                vx[k] = v[vi * 3 + axes[0]];
+                vy[k] = v[vi * 3 + axes[1]];
+            }
+        }
+
+        // Reflex corner
+        float e0x = vx[1] - vx[0];
+        float e0y = vy[1] - vy[0];
+        float e1x = vx[2] - vx[1];
+        float e1y = vy[2] - vy[1];
+        float cross = e0x * e1y - e0y * e1x;
+        if (cross * area < 0.0f)
+        {
+            ++guess;
+            continue;
+        }
+
+        bool overlap = false;
+        for (size_t other = 3; other < n && !overlap; ++other)
+        {
+            size_t ovi = size_t(remaining[(guess + other) % n].v_idx);
+            if (ovi * 3 + axes[0] >= v.size() || ovi * 3 + axes[1] >= v.size())
+                continue;
+            overlap = tinyobj::pnpoly(3, vx, vy, v[ovi * 3 + axes[0]], v[ovi * 3 + axes[1]]) != 0;
+        }
+
+        if (overlap)
+        {
+            ++guess;
+            continue;
+        }
+
+        AddTriangle(shape, ind, materialId, smoothingId);
+        remaining.erase(remaining.begin() + (guess + 1) % n);
+    }
+
+    if (remaining.size() == 3)
+        AddTriangle(shape, remaining.data(), materialId, smoothingId);
+}
+
+// Same as tinyobj's exportGroupsToShape with triangulation, triangles skip the ear clipping since it
+// always keeps them as they are
+bool ExportShape(tinyobj::shape_t& shape, const FaceList& faces, const tinyobj::PrimGroup& primGroup, const std::vector<tinyobj::tag_t>& tags, int materialId, const std::string& name, const std::vector<float>& v, std::vector<tinyobj::vertex_index_t>& scratch)
+{
+    if (faces.counts.empty() && primGroup.IsEmpty())
+        return false;
+
+    shape.name = name;
+
+    if (!faces.counts.empty())
+    {
+        const tinyobj::vertex_index_t* pFace = faces.indices.data();
+        for (size_t i = 0; i < faces.counts.size(); pFace += faces.counts[i++])
+        {
+            if (faces.counts[i] == 3)
+                AddTriangle(shape, pFace, materialId, faces.smoothingIds[i]);
+            else if (faces.counts[i] > 3)
+                TriangulateFace(shape, pFace, faces.counts[i], materialId, faces.smoothingIds[i], v, scratch);
+        }
+        shape.mesh.tags = tags;
+    }
+
+    for (size_t i = 0; i < primGroup.lineGroup.size(); ++i)
+    {
+        const std::vector<tinyobj::vertex_index_t>& line = primGroup.lineGroup[i].vertex_indices;
+        for (size_t j = 0; j < line.size(); ++j)
+        {
+            tinyobj::index_t index;
+            index.vertex_index = line[j].v_idx;
+            index.normal_index = line[j].vn_idx;
+            index.texcoord_index = line[j].vt_idx;
+            shape.lines.indices.push_back(index);
+        }
+        shape.lines.num_line_vertices.push_back((int)line.size());
+    }
+
+    for (size_t i = 0; i < primGroup.pointsGroup.size(); ++i)
+    {
+        const std::vector<tinyobj::vertex_index_t>& points = primGroup.pointsGroup[i].vertex_indices;
+        for (size_t j = 0; j < points.size(); ++j)
+        {
+            tinyobj::index_t index;
+            index.vertex_index = points[j].v_idx;
+            index.normal_index = points[j].vn_idx;
+            index.texcoord_index = points[j].vt_idx;
+            shape.points.indices.push_back(index);
+        }
+    }
+
+    return true;
+}
+
+bool ParseObj(const FileView& view, tinyobj::MaterialReader& materialReader, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials, std::string& warn, std::string& err)
+{
+    std::vector<float> v;
+    std::vector<float> vn;
+    std::vector<float> vt;
+    std::vector<float> vc;
+    std::vector<tinyobj::skin_weight_t> vw;
+    std::vector<tinyobj::tag_t> tags;
+    FaceList faces;
+    tinyobj::PrimGroup primGroup;
+    std::string name;
+
+    std::map<std::string, int> materialMap;
+    int material = -1;
+    unsigned int smoothingId = 0;
+
+    int greatestV = -1;
+    int greatestVn = -1;
+    int greatestVt = -1;
+
+    tinyobj::shape_t shape;
+    std::vector<tinyobj::vertex_index_t> scratch;
+
+    // Rare commands are copied out so tinyobj's null terminated helpers can read them
+    std::string lineBuffer;
+
+    size_t lineNumber = 0;
+    const char* p = view.GetData();
+    const char* pEnd = p + view.GetSize();
+    while (p < pEnd)
+    {
+        const char* pLine = p;
+        const char* pLineEnd = FindLineEnd(p, pEnd);
+
+        // tinyobj reads "\r\n" as one line end
+        p = FindNextLine(pLineEnd, pEnd);
+        if (p < pEnd)
+            p += (*p == '\r' && pEnd - p > 1 && p[1] == '\n') ? 2 : 1;
+        ++lineNumber;
+
+        const char* token = SkipBlanks(pLine, pLineEnd);
+        if (token == pLineEnd || token[0] == '#')
+            continue;
+
+        size_t length = pLineEnd - token;
+        if (length > 1 && token[0] == 'v' && IsBlank(token[1]))
+        {
+            token += 2;
+            float x = ParseReal(token, pLineEnd, 0.0f);
+            float y = ParseReal(token, pLineEnd, 0.0f);
+            float z = ParseReal(token, pLineEnd, 0.0f);
+
+            // Colors are only kept when all three parse, white otherwise
+            float r, g, b;
+            bool foundColor = TryParseReal(token, pLineEnd, r) && TryParseReal(token, pLineEnd, g) && TryParseReal(token, pLineEnd, b);
+            if (!foundColor)
+                r = g = b = 1.0f;
+
+            v.push_back(x);
+            v.push_back(y);
+            v.push_back(z);
+            vc.push_back(r);
+            vc.push_back(g);
+            vc.push_back(b);
+            continue;
+        }
+
+        if (length > 2 && token[0] == 'v' && token[1] == 'n' && IsBlank(token[2]))
+        {
+            token += 3;
+            float x = ParseReal(token, pLineEnd, 0.0f);
+            float y = ParseReal(token, pLineEnd, 0.0f);
+            float z = ParseReal(token, pLineEnd, 0.0f);
+            vn.push_back(x);
+            vn.push_back(y);
+            vn.push_back(z);
+            continue;
+        }
+
+        if (length > 2 && token[0] == 'v' && token[1] == 't' && IsBlank(token[2]))
+        {
+            token += 3;
+            float x = ParseReal(token, pLineEnd, 0.0f);
+            float y = ParseReal(token, pLineEnd, 0.0f);
+            vt.push_back(x);
+            vt.push_back(y);
+            continue;
+        }
+
+        if (length > 1 && token[0] == 'f' && IsBlank(token[1]))
+        {
+            token = SkipBlanks(token + 2, pLineEnd);
+
+            size_t first = faces.indices.size();
+            while (token < pLineEnd)
+            {
+                tinyobj::vertex_index_t index;
+                if (!ParseTriple(token, pLineEnd, (int)(v.size() / 3), (int)(vn.size() / 3), (int)(vt.size() / 2), index))
+                {
+                    err += "Failed parse `f' line(e.g. zero value for face index. line " + std::to_string(lineNumber) + ".)\n";
+                    return false;
+                }
+
+                greatestV = std::max(greatestV, index.v_idx);
+                greatestVn = std::max(greatestVn, index.vn_idx);
+                greatestVt = std::max(greatestVt, index.vt_idx);
+
+                faces.indices.push_back(index);
+                token = SkipBlanks(token, pLineEnd);
+            }
+
+            faces.counts.push_back((unsigned int)(faces.indices.size() - first));
+            faces.smoothingIds.push_back(smoothingId);
+            continue;
+        }
+
+        lineBuffer.assign(token, pLineEnd);
+        const char* command = lineBuffer.c_str();
+
+        if (command[0] == 'v' && command[1] == 'w' && IsBlank(command[2]))
+        {
+            command += 3;
+
+            tinyobj::skin_weight_t weight;
+            weight.vertex_id = tinyobj::parseInt(&command);
+            while (!IS_NEW_LINE(command[0]))
+            {
+                float joint, value;
+                tinyobj::parseReal2(&joint, &value, &command, -1.0);
+                if (joint < 0.0f)
+                {
+                    err += "Failed parse `vw' line. joint_id is negative. line " + std::to_string(lineNumber) + ".)\n";
+                    return false;
+                }
+
+                tinyobj::joint_and_weight_t jointWeight;
+                jointWeight.joint_id = int(joint);
+                jointWeight.weight = value;
+                weight.weightValues.push_back(jointWeight);
+
+                command += strspn(command, " \t\r");
+            }
+            vw.push_back(weight);
+            continue;
+        }
+
+        if ((command[0] == 'l' || command[0] == 'p') && IsBlank(command[1]))
+        {
+            bool line = command[0] == 'l';
+            command += 2;
+
+            std::vector<tinyobj::vertex_index_t> indices;
+            while (!IS_NEW_LINE(command[0]))
+            {
+                tinyobj::vertex_index_t index;
+                if (!tinyobj::parseTriple(&command, (int)(v.size() / 3), (int)(vn.size() / 3), (int)(vt.size() / 2), &index))
+                {
+                    if (line)
+                        err += "Failed parse `l' line(e.g. zero value for vertex index. line " + std::to_string(lineNumber) + ".)\n";
+                    else
+                        err += "Failed parse `p' line(e.g. zero value for vertex index. line " + std::to_string(lineNumber) + ".)\n";
+                    return false;
+                }
+
+                indices.push_back(index);
+                command += strspn(command, " \t\r");
+            }
+
+            if (line)
+            {
+                primGroup.lineGroup.push_back(tinyobj::__line_t());
+                primGroup.lineGroup.back().vertex_indices.swap(indices);
+            }
+            else
+            {
+                primGroup.pointsGroup.push_back(tinyobj::__points_t());
+                primGroup.pointsGroup.back().vertex_indices.swap(indices);
+            }
+            continue;
+        }
+
+        if (strncmp(command, "usemtl", 6) == 0)
+        {
+            command += 6;
+            std::string materialName = tinyobj::parseString(&command);
+
+            int materialId = -1;
+            auto it = materialMap.find(materialName);
+            if (it != materialMap.end())
+                materialId = it->second;
+            else
+                warn += "material [ '" + materialName + "' ] not found in .mtl\n";
+
+            // Faces so far keep the previous material
+            if (materialId != material)
+            {
+                ExportShape(shape, faces, primGroup, tags, material, name, v, scratch);
+                faces.Clear();
+                material = materialId;
+            }
+            continue;
+        }
+
+        if (strncmp(command, "mtllib", 6) == 0 && IsBlank(command[6]))
+        {
+            std::vector<std::string> filenames;
+            tinyobj::SplitString(std::string(command + 7), ' ', filenames);
+
+            if (filenames.empty())
+            {
+                warn += "Looks like empty filename for mtllib. Use default material (line " + std::to_string(lineNumber) + ".)\n";
+                continue;
+            }
+
+            bool found = false;
+            for (size_t i = 0; i < filenames.size() && !found; ++i)
+            {
+                std::string materialWarn;
+                std::string materialErr;
+                found = materialReader(filenames[i].c_str(), &materials, &materialMap, &materialWarn, &materialErr);
+                warn += materialWarn;
+                err += materialErr;
+            }
+
+            if (!found)
+                warn += "Failed to load material file(s). Use default material.\n";
+            continue;
+        }
+
+        if (command[0] == 'g' && IsBlank(command[1]))
+        {
+            ExportShape(shape, faces, primGroup, tags, material, name, v, scratch);
+            if (shape.mesh.indices.size() > 0)
+                shapes.push_back(std::move(shape));
+
+            shape = tinyobj::shape_t();
+            faces.Clear();
+            primGroup.clear();
+
+            // The first name is the g itself, several names are joined with spaces
+            std::vector<std::string> names;
+            while (!IS_NEW_LINE(command[0]))
+            {
+                names.push_back(tinyobj::parseString(&command));
+                command += strspn(command, " \t\r");
+            }
+
+            if (names.size() < 2)
+            {
+                warn += "Empty group name. line: " + std::to_string(lineNumber) + "\n";
+                name = "";
+            }
+            else
+            {
+                name = names[1];
+                for (size_t i = 2; i < names.size(); ++i)
+                    name += " " + names[i];
+            }
+            continue;
+        }
+
+        if (command[0] == 'o' && IsBlank(command[1]))
+        {
+            ExportShape(shape, faces, primGroup, tags, material, name, v, scratch);
+            if (shape.mesh.indices.size() > 0 || shape.lines.indices.size() > 0 || shape.points.indices.size() > 0)
+                shapes.push_back(std::move(shape));
+
+            faces.Clear();
+            primGroup.clear();
+            shape = tinyobj::shape_t();
+            name = command + 2;
+            continue;
+        }
+
+        if (command[0] == 't' && IsBlank(command[1]))
+        {
+            const int maxTagValues = 8192;
+            command += 2;
+
+            tinyobj::tag_t tag;
+            tag.name = tinyobj::parseString(&command);
+
+            tinyobj::tag_sizes sizes = tinyobj::parseTagTriple(&command);
+            sizes.num_ints = std::min(std::max(sizes.num_ints, 0), maxTagValues);
+            sizes.num_reals = std::min(std::max(sizes.num_reals, 0), maxTagValues);
+            sizes.num_strings = std::min(std::max(sizes.num_strings, 0), maxTagValues);
+
+            tag.intValues.resize(sizes.num_ints);
+            for (size_t i = 0; i < tag.intValues.size(); ++i)
+                tag.intValues[i] = tinyobj::parseInt(&command);
+
+            tag.floatValues.resize(sizes.num_reals);
+            for (size_t i = 0; i < tag.floatValues.size(); ++i)
+                tag.floatValues[i] = tinyobj::parseReal(&command);
+
+            tag.stringValues.resize(sizes.num_strings);
+            for (size_t i = 0; i < tag.stringValues.size(); ++i)
+                tag.stringValues[i] = tinyobj::parseString(&command);
+
+            tags.push_back(tag);
+            continue;
+        }
+
+        if (command[0] == 's' && IsBlank(command[1]))
+        {
+            command += 2;
+            command += strspn(command, " \t");
+
+            if (command[0] == '\0')
+                continue;
+
+            if (strncmp(command, "off", 3) == 0)
+            {
+                smoothingId = 0;
+            }
+            else
+            {
+                int id = tinyobj::parseInt(&command);
+                smoothingId = id < 0 ? 0 : (unsigned int)id;
+            }
+            continue;
+        }
+    }
+
+    // Checked once at the end like tinyobj, so only the last line number is reported
+    if (greatestV >= (int)(v.size() / 3))
+        warn += "Vertex indices out of bounds (line " + std::to_string(lineNumber) + ".)\n\n";
+    if (greatestVn >= (int)(vn.size() / 3))
+        warn += "Vertex normal indices out of bounds (line " + std::to_string(lineNumber) + ".)\n\n";
+    if (greatestVt >= (int)(vt.size() / 2))
+        warn += "Vertex texcoord indices out of bounds (line " + std::to_string(lineNumber) + ".)\n\n";
+
+    if (ExportShape(shape, faces, primGroup, tags, material, name, v, scratch) || shape.mesh.indices.size() > 0)
+        shapes.push_back(std::move(shape));
+
+    attrib.vertices.swap(v);
+    attrib.normals.swap(vn);
+    attrib.texcoords.swap(vt);
+    attrib.colors.swap(vc);
+    attrib.skin_weights.swap(vw);
+    return true;
+}
+
+bool LoadObj(const std::string& directory, const std::string& filename, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials)
+{
+    std::string warn;
+    std::string err;
+
+    // Parsed straight out of the page cache, materials included
+    std::string filepath = directory.size() > 0 ? directory + "/" + filename : filename;
+    FileView view;
+    if (!view.Open(filepath))
+    {
+        std::cerr << "Cannot open " << filepath << std::endl;
+        return false;
+    }
+
+    MaterialViewReader materialReader(directory);
+    bool ret = ParseObj(view, materialReader, attrib, shapes, materials, warn, err);
+
+    if (!warn.empty())
+        std::cout << warn << std::endl;
+
+    if (!err.empty())
+        std::cerr << err << std::endl;
+
+    return ret;
+}
+
+bool HasAlpha(const sf::Image& image)
+{
+    const sf::Uint8* pixels = image.getPixelsPtr();
+    size_t count = (size_t)image.getSize().x * image.getSize().y;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (pixels[i * 4 + 3] < 255)
+            return true;
+    }
+    return false;
+}
+
+bool HasAlpha(const std::string& filepath)
+{
+    // The baker records it in the container, so only the header is read and the source need not ship
+    TextureReader reader;
+    return reader.Open(TextureCodec::GetBakedPath(filepath)) && reader.alpha;
+}
+
+void ReloadTexture(Texture texture, const std::string& filepath)
+{
+    // Decoded here on the main thread, only the upload waits for the GL thread
+    std::shared_ptr<sf::Image> pImage = std::make_shared<sf::Image>();
+    if (!pImage->loadFromFile(filepath.c_str()))
+        return;
+
+    Engine::Defer([texture, pImage]()
+    {
+        Graphics::UpdateTexture(texture, TextureFormat::RBGA32, 0, pImage->getSize().x, pImage->getSize().y, pImage->getPixelsPtr());
+        Graphics::GenerateTextureMipmaps(texture);
+    });
+}
+
+struct LoadedTexture
+{
+    Texture texture;
+    bool alpha;
+    // Streamed textures belong to the streamer, which deletes them itself
+    bool streamed;
+};
+
+std::map<std::string, LoadedTexture>& LoadedTextures()
+{
+    // Shared by every material using the file and kept for the whole run, so reloads update them in place
+    static std::map<std::string, LoadedTexture> loaded;
+    return loaded;
+}
+
+Texture LoadTexture(const std::string& filepath, bool& alpha)
+{
+    std::map<std::string, LoadedTexture>& loaded = LoadedTextures();
+    auto it = loaded.find(filepath);
+    if (it != loaded.end())
+    {
+        alpha = it->second.alpha;
+        return it->second.texture;
+    }
+
+    alpha = false;
+
+    // Baked containers are streamed, anything else is decoded and mipmapped by the driver
+    Texture texture = Engine::Textures().Load(TextureCodec::GetBakedPath(filepath));
+    if (texture != 0)
+    {
+        alpha = HasAlpha(filepath);
+        loaded[filepath] = LoadedTexture{ texture, alpha, true };
+        return texture;
+    }
+
+    sf::Image image;
+    if (!image.loadFromFile(filepath.c_str()))
+        return 0;
+
+    alpha = HasAlpha(image);
 
-#include <iostream>
-#include <string>
-#include <fstream>
-#include <streambuf>
+    sf::Vector2u imageSize = image.getSize();
+    texture = Graphics::CreateTexture(TextureFormat::RBGA32, 1, imageSize.x, imageSize.y, image.getPixelsPtr(), true);
+    Graphics::FilterTexture(texture, TextureWrap::REPEAT, TextureWrap::REPEAT, TextureFilter::LINEAR_LINEAR, TextureFilter::LINEAR);
 
-#define ASSERT(expr) assert(expr)
+    loaded[filepath] = LoadedTexture{ texture, alpha, false };
+    Engine::Files().Watch(filepath, [texture, filepath]() { ReloadTexture(texture, filepath); });
+    return texture;
+}
 
-std::string Utility::LoadTextFile(const std::string& filepath)
+void FindMaterialLibraries(const std::string& directory, const std::string& filename, std::vector<std::string>& libraries)
 {
-    std::ifstream t(filepath);
-    return std::string((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+    FileView view;
+    if (!view.Open(directory.size() > 0 ? directory + "/" + filename : filename))
+        return;
+
+    // Exporters put mtllib ahead of the geometry, so the scan stops at the first vertex
+    const char* p = view.GetData();
+    const char* pEnd = p + view.GetSize();
+    while (p < pEnd && !(pEnd - p > 1 && p[0] == 'v' && p[1] == ' '))
+    {
+        const char* pLineEnd = std::find(p, pEnd, '\n');
+        if (pLineEnd - p > 7 && std::equal(p, p + 7, "mtllib "))
+        {
+            std::string library(p + 7, pLineEnd);
+            library.erase(library.find_last_not_of(" \t\r") + 1);
+            libraries.push_back(directory.size() > 0 ? directory + "/" + library : library);
+        }
+        p = pLineEnd < pEnd ? pLineEnd + 1 : pEnd;
+    }
 }
 
-bool LoadObj(const std::string& directory, const std::string& filename, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials)
+AlphaMode ClassifyMaterial(const tinyobj::material_t& material, bool textureAlpha)
 {
-    std::string warn;
-    std::string err;
+    // Exporters often write d 0 for opaque materials, so only partial opacity counts as blended
+    if (material.dissolve > 0.0f && material.dissolve < 1.0f)
+        return AlphaMode::BLEND;
+    if (textureAlpha || !material.alpha_texname.empty())
+        return AlphaMode::CUTOUT;
+    return AlphaMode::SOLID;
+}
 
-    std::string& filepath = directory.size() > 0 ? directory + "/" + filename : filename;
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str(), directory.c_str());
+template <typename Vertex>
+Bounds ComputeBounds(const Vertex* pData, size_t count)
+{
+    Bounds bounds;
+    if (count == 0)
+        return bounds;
 
-    if (!warn.empty())
-        std::cout << warn << std::endl;
+    bounds.min = bounds.max = pData[0].position;
+    for (size_t i = 1; i < count; ++i)
+    {
+        bounds.min = glm::min(bounds.min, pData[i].position);
+        bounds.max = glm::max(bounds.max, pData[i].position);
+    }
+    return bounds;
+}
 
-    if (!err.empty())
-        std::cerr << err << std::endl;
+// Smallest layout that keeps the mesh exact enough, color is left out when it is all white
+std::vector<AttributeFormat> ChooseLayout(const VertexPNCT* pData, size_t count, bool layered)
+{
+    glm::vec2 uvMin = count == 0 ? glm::vec2(0) : pData[0].texcoord;
+    glm::vec2 uvMax = uvMin;
+    bool color = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uvMin = glm::min(uvMin, pData[i].texcoord);
+        uvMax = glm::max(uvMax, pData[i].texcoord);
+        color |= pData[i].color != glm::vec4(1);
+    }
 
-    return ret;
+    std::vector<AttributeFormat> format;
+    format.emplace_back("vPos", 3);
+    format.emplace_back("vNor", 4, AttributeType::INT_2_10_10_10, true);
+
+    // Tiled coordinates leave the unit range, half floats stay within a texel up to 2 repeats of a 1k texture
+    if (glm::all(glm::greaterThanEqual(uvMin, glm::vec2(0))) && glm::all(glm::lessThanEqual(uvMax, glm::vec2(1))))
+        format.emplace_back("vTex", 2, AttributeType::UNSIGNED_SHORT, true);
+    else if (glm::all(glm::greaterThanEqual(uvMin, glm::vec2(-2))) && glm::all(glm::lessThanEqual(uvMax, glm::vec2(2))))
+        format.emplace_back("vTex", 2, AttributeType::HALF);
+    else
+        format.emplace_back("vTex", 2);
+
+    if (color)
+        format.emplace_back("vCol", 4, AttributeType::UNSIGNED_BYTE, true);
+    if (layered)
+        format.emplace_back("vLayer", 1, AttributeType::UNSIGNED_BYTE);
+    return format;
+}
+
+void WriteAttribute(const AttributeFormat& attribute, const glm::vec4& value, unsigned char* pDst)
+{
+    for (int c = 0; c < attribute.format && attribute.type != AttributeType::INT_2_10_10_10; ++c)
+    {
+        switch (attribute.type)
+        {
+        case AttributeType::FLOAT: std::memcpy(pDst + c * 4, &value[c], 4); break;
+        case AttributeType::HALF: { glm::uint16 h = glm::packHalf1x16(value[c]); std::memcpy(pDst + c * 2, &h, 2); break; }
+        case AttributeType::BYTE: pDst[c] = (unsigned char)(attribute.normalized ? glm::packSnorm1x8(value[c]) : (signed char)value[c]); break;
+        case AttributeType::UNSIGNED_BYTE: pDst[c] = attribute.normalized ? glm::packUnorm1x8(value[c]) : (unsigned char)value[c]; break;
+        case AttributeType::SHORT: { glm::int16 v = attribute.normalized ? (glm::int16)glm::packSnorm1x16(value[c]) : (glm::int16)value[c]; std::memcpy(pDst + c * 2, &v, 2); break; }
+        case AttributeType::UNSIGNED_SHORT: { glm::uint16 v = attribute.normalized ? glm::packUnorm1x16(value[c]) : (glm::uint16)value[c]; std::memcpy(pDst + c * 2, &v, 2); break; }
+        default: break;
+        }
+    }
+
+    if (attribute.type == AttributeType::INT_2_10_10_10)
+    {
+        glm::uint32 v = glm::packSnorm3x10_1x2(value);
+        std::memcpy(pDst, &v, 4);
+    }
+}
+
+void PackVertices(const VertexPNCT* pData, size_t count, const float* pLayers, const std::vector<AttributeFormat>& format, unsigned char* pDst)
+{
+    // Attribute at a time so the source is picked once per attribute rather than per vertex
+    size_t stride = Graphics::GetVertexSize(format);
+    size_t offset = 0;
+    for (size_t a = 0; a < format.size(); ++a)
+    {
+        const std::string& name = format[a].attribute;
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec4 value;
+            if (name == "vPos")
+                value = glm::vec4(pData[i].position, 1);
+            else if (name == "vNor")
+                value = glm::vec4(glm::dot(pData[i].normal, pData[i].normal) > 0 ? glm::normalize(pData[i].normal) : glm::vec3(0), 0);
+            else if (name == "vTex")
+                value = glm::vec4(pData[i].texcoord, 0, 0);
+            else if (name == "vCol")
+                value = pData[i].color;
+            else
+                value = glm::vec4(pLayers[i]);
+            WriteAttribute(format[a], value, &pDst[i * stride + offset]);
+        }
+        offset += Graphics::GetAttributeSize(format[a]);
+    }
+}
+
+// Meshes below this many triangles are not worth simplifying
+static const size_t lodMinTriangles = 256;
+// Meshes with at least this many triangles are split into meshlets
+static const size_t meshletMinTriangles = 2048;
+// Solid meshes at least this fraction of the scene's size across become occluders
+static const float occluderSceneFraction = 0.1f;
+
+// One model welded into indexed form with its simplified levels appended to the indices
+struct StagedMesh
+{
+    explicit StagedMesh(Arena& arena)
+        : vertices(arena), positions(arena), indices(arena)
+    {}
+
+    ArenaVector<unsigned char> vertices;
+    ArenaVector<VertexP> positions;
+    ArenaVector<unsigned int> indices;
+    unsigned int count = 0;
+    MeshLod lods[Mesh::maxLods];
+    int lodCount = 0;
+    std::vector<Meshlet> meshlets;
+    Bounds bounds;
+};
+
+size_t HashVertex(const unsigned char* pVertex, size_t stride)
+{
+    // FNV-1a over the packed bytes
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < stride; ++i)
+        hash = (hash ^ pVertex[i]) * 16777619u;
+    return hash;
+}
+
+void StageMesh(const VertexPNCT* pData, size_t count, const float* pLayers, const std::vector<AttributeFormat>& format, Arena& arena, StagedMesh& staged)
+{
+    size_t stride = Graphics::GetVertexSize(format);
+    staged.vertices.resize(count * stride);
+    PackVertices(pData, count, pLayers, format, staged.vertices.data());
+    staged.bounds = ComputeBounds(pData, count);
+
+    // Faces arrive as separate corners, welding equal packed vertices gives the simplifier its connectivity.
+    // The levels together stay under the size of the full mesh
+    staged.indices.reserve(count * 2);
+    staged.positions.reserve(count);
+
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity <<= 1;
+    Arena::Marker marker = arena.GetMarker();
+    ArenaVector<unsigned int> table(capacity, 0, arena);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const unsigned char* pVertex = &staged.vertices[i * stride];
+        size_t slot = HashVertex(pVertex, stride) & (capacity - 1);
+        while (table[slot] != 0 && std::memcmp(&staged.vertices[(table[slot] - 1) * stride], pVertex, stride) != 0)
+            slot = (slot + 1) & (capacity - 1);
+
+        if (table[slot] == 0)
+        {
+            if (unique != i)
+                std::memcpy(&staged.vertices[unique * stride], pVertex, stride);
+            table[slot] = (unsigned int)++unique;
+
+            VertexP position;
+            position.position = pData[i].position;
+            staged.positions.push_back(position);
+        }
+        staged.indices.push_back(table[slot] - 1);
+    }
+    staged.vertices.resize(unique * stride);
+    staged.count = (unsigned int)staged.indices.size();
+    arena.Rewind(marker);
+
+    if (count % 3 != 0 || count / 3 < lodMinTriangles)
+        return;
+
+    // Each level halves the one before, until locked seams and borders stop it from shrinking
+    std::vector<glm::vec3> points(unique);
+    for (size_t i = 0; i < unique; ++i)
+        points[i] = staged.positions[i].position;
+
+    std::vector<unsigned int> level(staged.indices.begin(), staged.indices.end());
+    std::vector<unsigned int> simplified;
+    float error = 0.0f;
+    while (staged.lodCount < Mesh::maxLods && level.size() / 3 >= lodMinTriangles)
+    {
+        error += MeshSimplifier::Simplify(points.data(), unique, level.data(), level.size(), level.size() / 6 * 3, simplified);
+        if (simplified.size() > level.size() * 3 / 4)
+            break;
+
+        MeshLod& lod = staged.lods[staged.lodCount++];
+        lod.offset = (unsigned int)staged.indices.size();
+        lod.count = (unsigned int)simplified.size();
+        lod.error = error;
+        staged.indices.insert(staged.indices.end(), simplified.begin(), simplified.end());
+        level.swap(simplified);
+    }
+
+    // Reordering the full level into meshlets leaves the levels after it untouched
+    if (count / 3 >= meshletMinTriangles)
+        Meshlets::Build(points.data(), unique, staged.indices.data(), staged.count, staged.meshlets);
+}
+
+// Simplified levels can bulge out in front of the real surface and hide what is actually visible, so occluders
+// keep the full level. Cutout and blended meshes hide nothing for sure
+void CreateOccluder(const StagedMesh& staged, float minSize, Model& model)
+{
+    if (model.material.alphaMode != AlphaMode::SOLID || glm::length(staged.bounds.max - staged.bounds.min) < minSize)
+        return;
+
+    std::vector<glm::vec3> points(staged.positions.size());
+    for (size_t i = 0; i < points.size(); ++i)
+        points[i] = staged.positions[i].position;
+
+    if (staged.count % 3 == 0)
+        model.mesh.occluder = OcclusionBuffer::CreateOccluder(points.data(), points.size(), staged.indices.data(), staged.count);
+}
+
+void SetMeshLevels(const StagedMesh& staged, unsigned int firstIndex, Mesh& mesh)
+{
+    mesh.offset = firstIndex;
+    mesh.count = staged.count;
+    mesh.lodCount = staged.lodCount;
+    for (int i = 0; i < staged.lodCount; ++i)
+    {
+        mesh.lods[i] = staged.lods[i];
+        mesh.lods[i].offset += firstIndex;
+    }
+}
+
+// The packed copies are staged in the arena and given back once uploaded
+void CreateMesh(const VertexPNCT* pData, size_t count, const float* pLayers, float occluderSize, Arena& arena, Model& model)
+{
+    std::vector<AttributeFormat> format = ChooseLayout(pData, count, pLayers != nullptr);
+    model.material.layout = Graphics::CreateLayout(format);
+
+    Arena::Marker marker = arena.GetMarker();
+    StagedMesh staged(arena);
+    StageMesh(pData, count, pLayers, format, arena, staged);
+
+    // Every layout is a multiple of 4 bytes
+    Mesh& mesh = model.mesh;
+    mesh.vBuffer = Graphics::CreateBuffer(1, staged.vertices.size() / sizeof(float), staged.vertices.data(), false, false);
+    mesh.pBuffer = Graphics::CreateBuffer(1, staged.positions.size() * (sizeof(VertexP) / sizeof(float)), staged.positions.data(), false, false);
+    mesh.iBuffer = Graphics::CreateBuffer(1, staged.indices.size(), staged.indices.data(), true, false);
+    SetMeshLevels(staged, 0, mesh);
+    model.bounds = staged.bounds;
+    CreateOccluder(staged, occluderSize, model);
+    if (!staged.meshlets.empty())
+        mesh.meshlets = Meshlets::Create(staged.meshlets);
+
+    arena.Rewind(marker);
+}
+
+// Vertices of a baked model waiting to be merged, they live in the import arena until then
+struct MeshSource
+{
+    size_t model;
+    const VertexPNCT* pData;
+    size_t count;
+    const float* pLayers;
+};
+
+// Models that end up with the same layout are packed back to back into shared vertex, position and index buffers
+void CreateMergedMeshes(const std::vector<MeshSource>& meshSources, float occluderSize, Arena& arena, std::vector<Model>& models)
+{
+    std::map<Layout, std::vector<size_t>> batches;
+    for (size_t i = 0; i < meshSources.size(); ++i)
+    {
+        const MeshSource& source = meshSources[i];
+        Layout layout = Graphics::CreateLayout(ChooseLayout(source.pData, source.count, source.pLayers != nullptr));
+        models[source.model].material.layout = layout;
+        batches[layout].push_back(i);
+    }
+
+    for (auto it = batches.begin(); it != batches.end(); ++it)
+    {
+        const std::vector<AttributeFormat>& format = Graphics::GetLayout(it->first);
+        const std::vector<size_t>& members = it->second;
+
+        Arena::Marker marker = arena.GetMarker();
+        std::vector<StagedMesh> staged;
+        staged.reserve(members.size());
+        size_t vertexBytes = 0;
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for (size_t j = 0; j < members.size(); ++j)
+        {
+            const MeshSource& source = meshSources[members[j]];
+            staged.emplace_back(arena);
+            StageMesh(source.pData, source.count, source.pLayers, format, arena, staged.back());
+            vertexBytes += staged.back().vertices.size();
+            vertexCount += staged.back().positions.size();
+            indexCount += staged.back().indices.size();
+        }
+
+        // Indices are rebased onto the shared vertices, so draws only need their first index
+        ArenaVector<unsigned char> vertices(arena);
+        ArenaVector<VertexP> positions(arena);
+        ArenaVector<unsigned int> indices(arena);
+        vertices.reserve(vertexBytes);
+        positions.reserve(vertexCount);
+        indices.reserve(indexCount);
+        for (size_t j = 0; j < members.size(); ++j)
+        {
+            const StagedMesh& mesh = staged[j];
+            Model& model = models[meshSources[members[j]].model];
+            SetMeshLevels(mesh, (unsigned int)indices.size(), model.mesh);
+            model.bounds = mesh.bounds;
+            CreateOccluder(mesh, occluderSize, model);
+            if (!mesh.meshlets.empty())
+                model.mesh.meshlets = Meshlets::Create(mesh.meshlets);
+
+            unsigned int baseVertex = (unsigned int)positions.size();
+            for (size_t i = 0; i < mesh.indices.size(); ++i)
+                indices.push_back(mesh.indices[i] + baseVertex);
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+        }
+
+        Buffer vBuffer = Graphics::CreateBuffer(1, vertices.size() / sizeof(float), vertices.data(), false, false);
+        Buffer pBuffer = Graphics::CreateBuffer(1, positions.size() * (sizeof(VertexP) / sizeof(float)), positions.data(), false, false);
+        Buffer iBuffer = Graphics::CreateBuffer(1, indices.size(), indices.data(), true, false);
+        for (size_t j = 0; j < members.size(); ++j)
+        {
+            Mesh& mesh = models[meshSources[members[j]].model].mesh;
+            mesh.vBuffer = vBuffer;
+            mesh.pBuffer = pBuffer;
+            mesh.iBuffer = iBuffer;
+        }
+
+        staged.clear();
+        arena.Rewind(marker);
+    }
+}
+
+void BakeVertices(VertexPNCT* pData, size_t count, const glm::mat4& m)
+{
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(m)));
+    for (size_t i = 0; i < count; ++i)
+    {
+        pData[i].position = glm::vec3(m * glm::vec4(pData[i].position, 1.0f));
+        pData[i].normal = normalMatrix * pData[i].normal;
+    }
+
+    // A mirroring transform turns the triangles around, swapping two corners keeps them front facing
+    if (glm::determinant(glm::mat3(m)) < 0.0f)
+    {
+        for (size_t i = 0; i + 2 < count; i += 3)
+            std::swap(pData[i + 1], pData[i + 2]);
+    }
+}
+
+// Material texture as found at import, before deciding whether it is packed into an array
+struct TextureSource
+{
+    std::string filepath;
+    TextureFormat format = TextureFormat::RBGA32;
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    bool baked = false;
+    bool alpha = false;
+};
+
+uint32_t ReadBigEndian(const unsigned char* p, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+uint32_t ReadLittleEndian(const unsigned char* p, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// Size and whether the image has an alpha channel, read from the header of the formats scenes ship with.
+// An alpha channel may still be all opaque, the pixels settle that once decoded
+bool ReadImageHeader(const std::string& filepath, int& width, int& height, bool& alpha)
+{
+    FileView view;
+    if (!view.Open(filepath))
+        return false;
+
+    const unsigned char* p = (const unsigned char*)view.GetData();
+    size_t size = view.GetSize();
+    static const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    if (size >= 33 && std::memcmp(p, pngSignature, 8) == 0 && std::memcmp(p + 12, "IHDR", 4) == 0)
+    {
+        width = (int)ReadBigEndian(p + 16, 4);
+        height = (int)ReadBigEndian(p + 20, 4);
+        alpha = p[25] == 4 || p[25] == 6;
+
+        // Palette and grey images carry transparency in a chunk ahead of the pixels
+        for (size_t offset = 8; !alpha && offset + 8 <= size; )
+        {
+            const unsigned char* pChunk = p + offset;
+            if (std::memcmp(pChunk + 4, "IDAT", 4) == 0)
+                break;
+            alpha = std::memcmp(pChunk + 4, "tRNS", 4) == 0;
+            offset += 12 + (size_t)ReadBigEndian(pChunk, 4);
+        }
+        return true;
+    }
+
+    if (size >= 4 && p[0] == 0xFF && p[1] == 0xD8)
+    {
+        // Markers up to the frame header, which holds the size
+        for (size_t offset = 2; offset + 9 <= size && p[offset] == 0xFF; )
+        {
+            unsigned char marker = p[offset + 1];
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                height = (int)ReadBigEndian(p + offset + 5, 2);
+                width = (int)ReadBigEndian(p + offset + 7, 2);
+                alpha = false;
+                return true;
+            }
+            offset += 2 + ReadBigEndian(p + offset + 2, 2);
+        }
+        return false;
+    }
+
+    if (size >= 30 && p[0] == 'B' && p[1] == 'M')
+    {
+        width = (int)ReadLittleEndian(p + 18, 4);
+        height = std::abs((int)ReadLittleEndian(p + 22, 4));
+        alpha = ReadLittleEndian(p + 28, 2) == 32;
+        return true;
+    }
+
+    // TGA has no signature, only the extension gives it away
+    size_t extension = filepath.find_last_of('.');
+    if (size >= 18 && extension != std::string::npos && (filepath.compare(extension, 4, ".tga") == 0 || filepath.compare(extension, 4, ".TGA") == 0))
+    {
+        width = (int)ReadLittleEndian(p + 12, 2);
+        height = (int)ReadLittleEndian(p + 14, 2);
+        alpha = (p[17] & 0x0F) != 0 || p[16] == 32 || p[7] == 32;
+        return true;
+    }
+
+    return false;
+}
+
+bool ProbeTexture(const std::string& filepath, TextureSource& source)
+{
+    source.filepath = filepath;
+
+    TextureReader reader;
+    if (reader.Open(TextureCodec::GetBakedPath(filepath)))
+    {
+        source.format = reader.format;
+        source.width = reader.width;
+        source.height = reader.height;
+        source.levels = reader.levels;
+        source.baked = true;
+        source.alpha = reader.alpha;
+        return true;
+    }
+
+    // Only the header is read here, raw images are decoded when packed and singles load on their own
+    if (!ReadImageHeader(filepath, source.width, source.height, source.alpha) || source.width <= 0 || source.height <= 0)
+        return false;
+
+    // Raw images get a full chain generated once packed
+    source.levels = 1;
+    while ((std::max(source.width, source.height) >> source.levels) > 0)
+        source.levels++;
+    return true;
+}
+
+Texture PackTextures(const std::vector<TextureSource*>& sources, bool& alpha)
+{
+    const TextureSource& first = *sources[0];
+    Texture texture = Graphics::CreateTextureArray(first.format, first.width, first.height, (int)sources.size(), first.levels);
+
+    alpha = false;
+    std::vector<unsigned char> data;
+    for (size_t layer = 0; layer < sources.size(); ++layer)
+    {
+        const TextureSource& source = *sources[layer];
+        if (!source.baked)
+        {
+            // One decoded image at a time, each is gone as soon as its layer is uploaded
+            sf::Image image;
+            if (!image.loadFromFile(source.filepath.c_str()) || (int)image.getSize().x != source.width || (int)image.getSize().y != source.height)
+            {
+                std::cerr << "Cannot pack " << source.filepath << std::endl;
+                continue;
+            }
+
+            alpha |= HasAlpha(image);
+            Graphics::UpdateTextureLayer(texture, source.format, 0, (int)layer, source.width, source.height, image.getPixelsPtr());
+            continue;
+        }
+
+        alpha |= source.alpha;
+
+        TextureReader reader;
+        if (!reader.Open(TextureCodec::GetBakedPath(source.filepath)))
+            continue;
+
+        for (int level = 0; level < reader.levels; ++level)
+        {
+            if (reader.ReadLevel(level, data))
+                Graphics::UpdateTextureLayer(texture, source.format, level, (int)layer, reader.GetLevelWidth(level), reader.GetLevelHeight(level), &data[0]);
+        }
+    }
+
+    if (!first.baked)
+        Graphics::GenerateTextureArrayMipmaps(texture);
+
+    Graphics::FilterTextureArray(texture, TextureWrap::REPEAT, TextureWrap::REPEAT, TextureFilter::LINEAR_LINEAR, TextureFilter::LINEAR);
+    return texture;
 }
 
 void ParseVertex(VertexPNCT& vertex, const tinyobj::index_t& idx, const tinyobj::attrib_t& attrib)
@@ -68,18 +1727,18 @@ Model Utility::LoadModel(const std::string& directory, const std::string& filena
         Material& material = model.material;
         material.diffuse = glm::vec3(materials[0].diffuse[0], materials[0].diffuse[1], materials[0].diffuse[2]);
 
-        sf::Image image;
-        if (image.loadFromFile((directory + "/" + materials[0].diffuse_texname).c_str()))
-        {
-            sf::Vector2u imageSize = image.getSize();
-            material.albedo = Graphics::CreateTexture(TextureFormat::RBGA32, 1, imageSize.x, imageSize.y, image.getPixelsPtr(), true);
-            Graphics::FilterTexture(material.albedo, TextureWrap::REPEAT, TextureWrap::REPEAT, TextureFilter::LINEAR_LINEAR, TextureFilter::LINEAR);
-        }
-
-        material.attributeFormat = VertexPNCT::format;
+        bool alpha;
+        material.albedo = LoadTexture(directory + "/" + materials[0].diffuse_texname, alpha);
+        material.alphaMode = ClassifyMaterial(materials[0], alpha);
     }
 
-    std::vector<VertexPNCT> meshData;
+    size_t vertexCount = 0;
+    for (size_t s = 0; s < shapes.size(); s++)
+        vertexCount += shapes[s].mesh.indices.size();
+
+    Arena arena;
+    ArenaVector<VertexPNCT> meshData(arena);
+    meshData.reserve(vertexCount);
 
     // Loop over shapes
     for (size_t s = 0; s < shapes.size(); s++)
@@ -96,47 +1755,104 @@ Model Utility::LoadModel(const std::string& directory, const std::string& filena
                 VertexPNCT vertex;
                 tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
                 ParseVertex(vertex, idx, attrib);
+                if (model.material.alphaMode == AlphaMode::BLEND)
+                    vertex.color.a = materials[0].dissolve;
                 meshData.emplace_back(vertex);
             }
             index_offset += fv;
         }
     }
 
-    Mesh& mesh = model.mesh;
-    mesh.vBuffer = Graphics::CreateBuffer(1, meshData.size() * (sizeof(VertexPNCT) / sizeof(float)), &meshData[0], false, false);
-    mesh.count = meshData.size();
+    CreateMesh(meshData.data(), meshData.size(), nullptr, 0.0f, arena, model);
 
     return model;
 }
 
-std::vector<Model> Utility::LoadScene(const std::string& directory, const std::string& filename)
+bool Utility::LoadScene(const std::string& directory, const std::string& filename, std::vector<Model>& result, bool packTextures, std::vector<std::string>* pDependencies, const Transform* pBake)
 {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
 
+    // Hot reload gets here for files still being written, the caller keeps what it had
+    result.clear();
     if (!LoadObj(directory, filename, attrib, shapes, materials))
-        throw;
+    {
+        std::cerr << "Cannot import " << (directory.size() > 0 ? directory + "/" + filename : filename) << std::endl;
+        return false;
+    }
+
+    // Textures outside arrays reload in place, everything else needs the scene imported again
+    if (pDependencies != nullptr)
+    {
+        pDependencies->push_back(directory.size() > 0 ? directory + "/" + filename : filename);
+        FindMaterialLibraries(directory, filename, *pDependencies);
+    }
 
     std::vector<Model> models(materials.size());
+
+    // Materials whose textures agree in format, size, levels and origin share a texture array, baked layers bring their own mips
+    typedef std::tuple<AlphaMode, TextureFormat, int, int, int, bool> GroupKey;
+    std::vector<TextureSource> sources(packTextures ? materials.size() : 0);
+    std::map<GroupKey, std::vector<size_t>> groups;
+    std::vector<bool> packed(materials.size(), false);
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (materials[i].diffuse_texname.empty() || !ProbeTexture(directory + "/" + materials[i].diffuse_texname, sources[i]))
+            continue;
+
+        AlphaMode alphaMode = models[i].material.alphaMode = ClassifyMaterial(materials[i], sources[i].alpha);
+        groups[GroupKey(alphaMode, sources[i].format, sources[i].width, sources[i].height, sources[i].levels, sources[i].baked)].push_back(i);
+    }
+
+    for (auto it = groups.begin(); it != groups.end(); ++it)
+    {
+        if (it->second.size() < 2)
+            continue;
+
+        for (size_t j = 0; j < it->second.size(); ++j)
+            packed[it->second[j]] = true;
+    }
     
     for (size_t i = 0; i < materials.size(); i++)
     {
         Material& material = models[i].material;
         material.diffuse = glm::vec3(materials[i].diffuse[0], materials[i].diffuse[1], materials[i].diffuse[2]);
 
-        sf::Image image;
-        if (image.loadFromFile((directory + "/" + materials[i].diffuse_texname).c_str()))
+        if (!packed[i])
         {
-            sf::Vector2u imageSize = image.getSize();
-            material.albedo = Graphics::CreateTexture(TextureFormat::RBGA32, 1, imageSize.x, imageSize.y, image.getPixelsPtr(), true);
-            Graphics::FilterTexture(material.albedo, TextureWrap::REPEAT, TextureWrap::REPEAT, TextureFilter::LINEAR_LINEAR, TextureFilter::LINEAR);
+            bool alpha;
+            material.albedo = LoadTexture(directory + "/" + materials[i].diffuse_texname, alpha);
+            material.alphaMode = ClassifyMaterial(materials[i], alpha);
         }
+    }
 
-        material.attributeFormat = VertexPNCT::format;
+    // Every temporary below lives in one arena sized from the face counts, so the streams never
+    // regrow and all of it goes at once when the import returns
+    std::vector<size_t> vertexCounts(materials.size(), 0);
+    for (size_t s = 0; s < shapes.size(); s++)
+    {
+        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+        {
+            int matId = shapes[s].mesh.material_ids[f];
+            if (matId >= 0)
+                vertexCounts[matId] += shapes[s].mesh.num_face_vertices[f];
+        }
     }
 
-    std::vector<std::vector<VertexPNCT>> meshData(materials.size());
+    size_t totalCount = 0;
+    for (size_t i = 0; i < vertexCounts.size(); i++)
+        totalCount += vertexCounts[i];
+
+    Arena arena(totalCount * sizeof(VertexPNCT) + (1 << 16));
+    std::vector<ArenaVector<VertexPNCT>> meshData;
+    meshData.reserve(materials.size());
+    for (size_t i = 0; i < materials.size(); i++)
+    {
+        meshData.emplace_back(arena);
+        meshData.back().reserve(vertexCounts[i]);
+    }
 
     // Loop over shapes
     for (size_t s = 0; s < shapes.size(); s++)
@@ -145,11 +1861,15 @@ std::vector<Model> Utility::LoadScene(const std::string& directory, const std::s
         size_t index_offset = 0;
         for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
         {
-            // per-face material
+            // per-face material, faces without one have no model to go to
             int matId = shapes[s].mesh.material_ids[f];
-            std::vector<VertexPNCT>& data = meshData[matId];
-
             int fv = shapes[s].mesh.num_face_vertices[f];
+            if (matId < 0)
+            {
+                index_offset += fv;
+                continue;
+            }
+            ArenaVector<VertexPNCT>& data = meshData[matId];
 
             // Loop over vertices in the face.
             for (size_t v = 0; v < fv; v++)
@@ -157,20 +1877,160 @@ std::vector<Model> Utility::LoadScene(const std::string& directory, const std::s
                 VertexPNCT vertex;
                 tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
                 ParseVertex(vertex, idx, attrib);
+                if (models[matId].material.alphaMode == AlphaMode::BLEND)
+                    vertex.color.a = materials[matId].dissolve;
                 data.emplace_back(vertex);
             }
             index_offset += fv;
         }
     }
 
+    // The parsed file is not needed past this point, dropping it lowers the peak while uploading
+    attrib = tinyobj::attrib_t();
+    std::vector<tinyobj::shape_t>().swap(shapes);
+
+    if (pBake != nullptr)
+    {
+        glm::mat4 m = glm::translate(glm::mat4(1), pBake->position) * glm::mat4(glm::quat(glm::radians(pBake->rotation))) * glm::scale(glm::mat4(1), pBake->scale);
+        for (size_t i = 0; i < meshData.size(); i++)
+            BakeVertices(meshData[i].data(), meshData[i].size(), m);
+    }
+
+    // Occluders are picked relative to the whole scene, in the space the vertices end up in
+    Bounds sceneBounds;
+    bool sceneEmpty = true;
+    for (size_t i = 0; i < meshData.size(); i++)
+    {
+        if (meshData[i].empty())
+            continue;
+
+        Bounds bounds = ComputeBounds(meshData[i].data(), meshData[i].size());
+        sceneBounds.min = sceneEmpty ? bounds.min : glm::min(sceneBounds.min, bounds.min);
+        sceneBounds.max = sceneEmpty ? bounds.max : glm::max(sceneBounds.max, bounds.max);
+        sceneEmpty = false;
+    }
+    float occluderSize = glm::length(sceneBounds.max - sceneBounds.min) * occluderSceneFraction;
+
+    // Baked models are uploaded together once all of them are known, the rest as each one is finished
+    std::vector<MeshSource> meshSources;
     for (size_t i = 0; i < materials.size(); i++)
     {
-        std::vector<VertexPNCT>& data = meshData[i];
+        ArenaVector<VertexPNCT>& data = meshData[i];
+        if (packed[i] || data.empty())
+            continue;
+
+        if (pBake != nullptr)
+            meshSources.push_back(MeshSource{ result.size(), data.data(), data.size(), nullptr });
+        else
+            CreateMesh(data.data(), data.size(), nullptr, occluderSize, arena, models[i]);
+        result.emplace_back(std::move(models[i]));
+    }
+
+    // Each group becomes a single model, the vertex layer picks the material's texture
+    for (auto it = groups.begin(); it != groups.end(); ++it)
+    {
+        const std::vector<size_t>& members = it->second;
+        if (members.size() < 2)
+            continue;
+
+        size_t groupCount = 0;
+        for (size_t j = 0; j < members.size(); ++j)
+            groupCount += meshData[members[j]].size();
+
+        if (groupCount == 0)
+            continue;
+
+        Arena::Marker marker = arena.GetMarker();
+        std::vector<TextureSource*> textures;
+        ArenaVector<VertexPNCT> data(arena);
+        ArenaVector<float> layers(arena);
+        data.reserve(groupCount);
+        layers.reserve(groupCount);
+        for (size_t j = 0; j < members.size(); ++j)
+        {
+            textures.emplace_back(&sources[members[j]]);
+            if (pDependencies != nullptr)
+                pDependencies->push_back(sources[members[j]].baked ? TextureCodec::GetBakedPath(sources[members[j]].filepath) : sources[members[j]].filepath);
+
+            const ArenaVector<VertexPNCT>& memberData = meshData[members[j]];
+            data.insert(data.end(), memberData.begin(), memberData.end());
+            layers.insert(layers.end(), memberData.size(), (float)j);
+        }
+
+        Model model;
+        model.material.diffuse = models[members[0]].material.diffuse;
+        bool alpha;
+        model.material.albedo = PackTextures(textures, alpha);
+        model.material.albedoArray = true;
+        model.material.alphaMode = models[members[0]].material.alphaMode;
+
+        // The group was keyed on alpha channels, an all opaque one still makes a solid material
+        if (model.material.alphaMode == AlphaMode::CUTOUT && !alpha)
+        {
+            model.material.alphaMode = AlphaMode::SOLID;
+            for (size_t j = 0; j < members.size(); ++j)
+            {
+                if (ClassifyMaterial(materials[members[j]], false) == AlphaMode::CUTOUT)
+                    model.material.alphaMode = AlphaMode::CUTOUT;
+            }
+        }
+
+        // Arena vectors never free, so a baked group's copy stays valid until the merge below
+        if (pBake != nullptr)
+        {
+            meshSources.push_back(MeshSource{ result.size(), data.data(), data.size(), layers.data() });
+        }
+        else
+        {
+            CreateMesh(data.data(), data.size(), layers.data(), occluderSize, arena, model);
+            arena.Rewind(marker);
+        }
+        result.emplace_back(std::move(model));
+    }
+
+    if (pBake != nullptr)
+        CreateMergedMeshes(meshSources, occluderSize, arena, result);
+
+    return true;
+}
+
+void Utility::ReleaseModels(const std::vector<Model>& models)
+{
+    // Baked models share their buffers, each one is deleted once
+    std::vector<Buffer> buffers;
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        const Mesh& mesh = models[i].mesh;
+        if (mesh.vBuffer != 0)
+            buffers.push_back(mesh.vBuffer);
+        if (mesh.pBuffer != 0)
+            buffers.push_back(mesh.pBuffer);
+        if (mesh.iBuffer != 0)
+            buffers.push_back(mesh.iBuffer);
+    }
 
-        Mesh& mesh = models[i].mesh;
-        mesh.vBuffer = Graphics::CreateBuffer(1, data.size() * (sizeof(VertexPNCT) / sizeof(float)), &data[0], false, false);
-        mesh.count = data.size();
+    std::sort(buffers.begin(), buffers.end());
+    buffers.erase(std::unique(buffers.begin(), buffers.end()), buffers.end());
+    for (size_t i = 0; i < buffers.size(); ++i)
+        Graphics::DeleteBuffer(1, buffers[i]);
+
+    // Other textures are shared through the load cache and go with ReleaseTextures
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        OcclusionBuffer::DeleteOccluder(models[i].mesh.occluder);
+        Meshlets::Delete(models[i].mesh.meshlets);
+        if (models[i].material.albedoArray)
+            Graphics::DeleteTexture(1, models[i].material.albedo);
     }
+}
 
-    return models;
+void Utility::ReleaseTextures()
+{
+    std::map<std::string, LoadedTexture>& loaded = LoadedTextures();
+    for (auto it = loaded.begin(); it != loaded.end(); ++it)
+    {
+        if (!it->second.streamed)
+            Graphics::DeleteTexture(1, it->second.texture);
+    }
+    loaded.clear();
 }
\ No newline at end of file
@@ -8,12 +8,50 @@
 #include <string>
 #include <vector>
 
+// Read-only view of a whole file mapped into memory, the bytes stay valid until it is closed
+class FileView
+{
+public:
+    FileView() {}
+    ~FileView();
+
+    FileView(FileView&& other);
+    FileView& operator=(FileView&& other);
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    bool Open(const std::string& filepath);
+    void Close();
+
+    const char* GetData() const { return pData; }
+    size_t GetSize() const { return size; }
+
+private:
+    const char* pData = nullptr;
+    size_t size = 0;
+    void* pMapping = nullptr;
+};
+
 class Utility
 {
 public:
     static std::string LoadTextFile(const std::string& filepath);
 
+    // Defines are inserted after the #version line
+    static std::string InjectDefines(const std::string& source, const std::vector<std::string>& defines);
+    static Shader LoadShader(const std::string& vPath, const std::string& pPath, const std::vector<std::string>& defines = std::vector<std::string>());
+
     static Model LoadModel(const std::string& directory, const std::string& filename);
 
-    static std::vector<Model> LoadScene(const std::string& directory, const std::string& filename);
+    // Packing merges materials with same sized textures into one model sampling a texture array,
+    // dependencies receives the files the models have to be imported again for when they change.
+    // Baking is for geometry that never moves, the transform goes into the vertices, models sharing a
+    // layout share their buffers and all of them come back with an identity transform. Returns false and
+    // creates nothing when the file cannot be read or parsed
+    static bool LoadScene(const std::string& directory, const std::string& filename, std::vector<Model>& models, bool packTextures = false, std::vector<std::string>* pDependencies = nullptr, const Transform* pBake = nullptr);
+
+    // GL thread, frees the buffers, texture arrays, occluders and meshlets LoadScene created
+    static void ReleaseModels(const std::vector<Model>& models);
+    // GL thread at shutdown, frees the textures shared through the load cache
+    static void ReleaseTextures();
 };
\ No newline at end of file
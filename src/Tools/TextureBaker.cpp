@@ -0,0 +1,120 @@
+// Bakes images into .ktx containers next to their source files so loading is a plain upload
+// Usage: TextureBaker [--bc7|--rgba] <image or .mtl>...
+
+#include <Framework/Graphics.hpp>
+#include <Framework/TextureCodec.hpp>
+
+#include <tiny_obj_loader.h>
+
+#include <SFML/Graphics.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+bool highQuality = false;
+bool uncompressed = false;
+
+bool HasAlpha(const sf::Image& image)
+{
+    const sf::Uint8* pixels = image.getPixelsPtr();
+    size_t count = image.getSize().x * image.getSize().y;
+    for (size_t i = 0; i < count; ++i)
+        if (pixels[i * 4 + 3] != 255)
+            return true;
+    return false;
+}
+
+bool BakeImage(const std::string& filepath, bool normalMap)
+{
+    sf::Image image;
+    if (!image.loadFromFile(filepath))
+        return false;
+
+    TextureFormat format;
+    if (uncompressed)
+        format = TextureFormat::RBGA32;
+    else if (normalMap)
+        format = TextureFormat::BC5;
+    else if (highQuality)
+        format = TextureFormat::BC7;
+    else
+        format = HasAlpha(image) ? TextureFormat::BC3 : TextureFormat::BC1;
+
+    TextureData texture;
+    TextureCodec::Bake(format, image.getSize().x, image.getSize().y, image.getPixelsPtr(), !normalMap, texture);
+
+    std::string bakedPath = TextureCodec::GetBakedPath(filepath);
+    if (!TextureCodec::Save(bakedPath, texture))
+    {
+        std::cerr << "Failed to write " << bakedPath << std::endl;
+        return false;
+    }
+
+    std::cout << filepath << " -> " << bakedPath << " (" << texture.levels.size() << " levels)" << std::endl;
+    return true;
+}
+
+bool BakeMaterials(const std::string& filepath)
+{
+    std::ifstream file(filepath);
+    if (!file)
+        return false;
+
+    std::map<std::string, int> materialMap;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    std::string err;
+    tinyobj::LoadMtl(&materialMap, &materials, &file, &warn, &err);
+
+    if (!err.empty())
+        std::cerr << err << std::endl;
+
+    size_t separator = filepath.find_last_of("/\\");
+    std::string directory = separator == std::string::npos ? "" : filepath.substr(0, separator + 1);
+
+    // Materials share textures, bake each one once
+    std::map<std::string, bool> textures;
+    for (size_t i = 0; i < materials.size(); ++i)
+    {
+        if (!materials[i].diffuse_texname.empty())
+            textures[materials[i].diffuse_texname] = false;
+        if (!materials[i].bump_texname.empty())
+            textures[materials[i].bump_texname] = true;
+        if (!materials[i].displacement_texname.empty())
+            textures[materials[i].displacement_texname] = true;
+    }
+
+    bool success = true;
+    for (std::map<std::string, bool>::iterator it = textures.begin(); it != textures.end(); ++it)
+        success &= BakeImage(directory + it->first, it->second);
+
+    return success;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: TextureBaker [--bc7|--rgba] <image or .mtl>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool success = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--bc7")
+            highQuality = true;
+        else if (arg == "--rgba")
+            uncompressed = true;
+        else if (arg.size() > 4 && arg.compare(arg.size() - 4, 4, ".mtl") == 0)
+            success &= BakeMaterials(arg);
+        else
+            success &= BakeImage(arg, false);
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
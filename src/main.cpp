@@ -8,6 +8,16 @@ int main()
     settings.antialiasingLevel = 4;
     settings.majorVersion = 3;
     settings.minorVersion = 3;
+#ifndef NDEBUG
+    // Debug contexts are required for KHR_debug messages on most drivers
+    settings.attributeFlags = sf::ContextSettings::Debug;
+#endif
 
-    return Engine::Run(new Application(), "Template", 800, 600, settings);
+    LoopSettings loop;
+    loop.fixedStep = true;
+    loop.stepRate = 60.0f;
+    loop.vsync = VSync::ADAPTIVE;
+    loop.renderThread = true;
+
+    return Engine::Run(new Application(), "Template", 800, 600, settings, loop);
 }
\ No newline at end of file